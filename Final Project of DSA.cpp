@@ -1,553 +1,5890 @@
-#include <iostream>
-#include <string>
-#include <vector>
-#include <queue>
-#include <stack>
-#include <algorithm>
-#include <ctime>
-#include <cstdlib>
-#include <limits>
-#include <conio.h>
-#include <sstream>
-
-using namespace std;
-
-// ===============================
-// COLOR CODES (for console text colors)
-// ===============================
-#define RESET   "\033[0m"
-#define RED     "\033[31m"
-#define GREEN   "\033[32m"
-#define YELLOW  "\033[33m"
-#define BLUE    "\033[34m"
-#define MAGENTA "\033[35m"
-#define CYAN    "\033[36m"
-#define WHITE   "\033[37m"
-
-// ===============================
-// HELPER FUNCTIONS
-// ===============================
-
-// Clear screen using system command
-void clearScreen() {
-    system("cls");
-}
-
-// Wait for user to press enter
-void waitForEnter() {
-    cout << YELLOW << "\nPress ENTER to continue..." << RESET;
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-}
-
-// Convert integer to string
-string intToString(int x) {
-    stringstream ss;
-    ss << x;
-    return ss.str();
-}
-
-// ===============================
-// CARD CLASS
-// ===============================
-
-// Represents a single card with name, power, and rarity
-class Card {
-private:
-    string name;
-    int power;
-    string rarity;
-
-public:
-    // Default constructor
-    Card() {
-        name = "Unknown";
-        power = 0;
-        rarity = "Common";
-    }
-
-    // Parameterized constructor
-    Card(string n, int p, string r) {
-        name = n;
-        power = p;
-        rarity = r;
-    }
-
-    // Getters
-    string getName() const { return name; }
-    int getPower() const { return power; }
-    string getRarity() const { return rarity; }
-
-    // Rarity colors for display
-    string rarityColor() const {
-        if (rarity == "Legendary") return RED;
-        if (rarity == "Epic") return MAGENTA;
-        if (rarity == "Rare") return BLUE;
-        return WHITE;
-    }
-
-    // Display card info
-    void display() const {
-        cout << rarityColor() << name
-             << " (" << rarity << " | Power: " << power << ")"
-             << RESET;
-    }
-};
-
-// ===============================
-// PLAYER CLASS
-// ===============================
-
-class Player {
-private:
-    string name;
-    queue<Card> deck;       // Cards to draw
-    stack<Card> discard;    // Cards won
-
-public:
-    Player(string n = "Player") {
-        name = n;
-    }
-
-    // Set / get name
-    void setName(string n) { name = n; }
-    string getName() const { return name; }
-
-    // Add card to player's deck
-    void addCardToDeck(const Card &c) { deck.push(c); }
-
-    // Check if player still has cards
-    bool hasCards() const { return !deck.empty(); }
-
-    // Remaining cards count
-    int remainingCards() const { return (int)deck.size(); }
-
-    // Draw top card
-    Card drawCard() {
-        Card c = deck.front();
-        deck.pop();
-        return c;
-    }
-
-    // Player wins round and takes both cards
-    void addWinCards(const Card &c1, const Card &c2) {
-        discard.push(c1);
-        discard.push(c2);
-    }
-
-    // Draw result is tie
-    void keepOwnCard(const Card &c) {
-        discard.push(c);
-    }
-
-    // Score is total cards in discard
-    int getScore() const { return (int)discard.size(); }
-
-    // Copy deck for viewing
-    queue<Card> getDeckSnapshot() const {
-        return deck;
-    }
-};
-
-// ===============================
-// GAME CLASS
-// ===============================
-
-class Game {
-private:
-    vector<Card> cardPool;  // All generated cards
-    Player p1, p2;
-    bool vsComputer;        // Mode flag
-    int roundNumber;
-
-public:
-    Game() {
-        vsComputer = true;
-        roundNumber = 1;
-    }
-
-    // Show title screen
-    void showTitleScreen() {
-        clearScreen();
-        cout << CYAN;
-        cout << "=====================================\n";
-        cout << "           CARD BATTLE GAME          \n";
-        cout << "=====================================\n";
-        cout << "       A DSA-based Console Game      \n";
-        cout << "-------------------------------------\n\n";
-        cout << RESET;
-    }
-
-    // Main menu before game
-    int showStartMenu() {
-        int choice = -1;
-        do {
-            cout << YELLOW << "1. Start New Game\n0. Exit\nEnter choice: " << RESET;
-            cin >> choice;
-
-            if (cin.fail()) {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                choice = -1;
-            }
-        } while (choice != 0 && choice != 1);
-
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
-        return choice;
-    }
-
-    // Choose PvP or PvC mode
-    void chooseMode() {
-        int mode = -1;
-        do {
-            clearScreen();
-            cout << CYAN << "Choose Game Mode:\n" << RESET;
-            cout << YELLOW << "1. Player vs Computer\n2. Player vs Player\nEnter choice: " << RESET;
-            cin >> mode;
-
-            if (cin.fail()) {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                mode = -1;
-            }
-        } while (mode != 1 && mode != 2);
-
-        vsComputer = (mode == 1);
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    }
-
-    // Player names setup
-    void setupPlayers() {
-        clearScreen();
-        string name;
-
-        cout << CYAN << "Enter Player 1 name: " << RESET;
-        getline(cin, name);
-        if (name.empty()) name = "Player1";
-        p1.setName(name);
-
-        if (vsComputer) {
-            p2.setName("Computer");
-        } else {
-            cout << CYAN << "Enter Player 2 name: " << RESET;
-            getline(cin, name);
-            if (name.empty()) name = "Player2";
-            p2.setName(name);
-        }
-
-        clearScreen();
-        cout << GREEN << "Match Setup:\n" << RESET;
-        cout << GREEN << p1.getName() << RESET << "  VS  "
-             << GREEN << p2.getName() << RESET << "\n";
-        waitForEnter();
-    }
-
-    // Card count + distribution settings
-    void askGameSettings(int &totalCards, int &distMode) {
-        clearScreen();
-        do {
-            cout << YELLOW << "Enter TOTAL number of cards (even number, min 4): " << RESET;
-            cin >> totalCards;
-
-            if (cin.fail()) {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                totalCards = -1;
-            }
-        } while (totalCards < 4);
-
-        if (totalCards % 2 != 0) {
-            totalCards--;
-            cout << MAGENTA << "Adjusted to even total: " << totalCards << RESET << "\n";
-        }
-
-        do {
-            cout << CYAN << "\nChoose card distribution style:\n" << RESET;
-            cout << YELLOW << "1. Alternate dealing\n2. First half to P1\n3. Random equal\nEnter choice: " << RESET;
-            cin >> distMode;
-
-            if (cin.fail()) {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                distMode = -1;
-            }
-        } while (distMode < 1 || distMode > 3);
-
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
-
-        clearScreen();
-        cout << CYAN << "Game Settings:\n" << RESET;
-        cout << YELLOW << "Total cards: " << totalCards << "\nDistribution mode: " << distMode << RESET << "\n";
-        waitForEnter();
-    }
-
-    // Convert power to rarity
-    string getRarity(int power) {
-        if (power >= 90) return "Legendary";
-        if (power >= 70) return "Epic";
-        if (power >= 50) return "Rare";
-        return "Common";
-    }
-
-    // Create card pool and distribute to players
-    void generateAndDistributeCards(int totalCards, int distMode) {
-        clearScreen();
-        cout << CYAN << "Generating cards...\n" << RESET;
-
-        vector<string> baseNames = {
-            "Knight", "Dragon", "Wizard", "Archer", "Assassin",
-            "Golem", "Hunter", "Paladin", "Samurai", "Mage"
-        };
-
-        cardPool.clear();
-
-        // Generate random cards
-        for (int i = 0; i < totalCards; ++i) {
-            string nm = baseNames[i % baseNames.size()] + " #" + intToString(i + 1);
-            int power = (rand() % 91) + 10;
-            string rarity = getRarity(power);
-            cardPool.push_back(Card(nm, power, rarity));
-        }
-
-        random_shuffle(cardPool.begin(), cardPool.end());
-
-        // Reset players
-        p1 = Player(p1.getName());
-        p2 = Player(p2.getName());
-
-        int half = totalCards / 2;
-
-        // THREE distribution modes
-        if (distMode == 1) {
-            for (int i = 0; i < totalCards; i++)
-                (i % 2 == 0 ? p1 : p2).addCardToDeck(cardPool[i]);
-        } else if (distMode == 2) {
-            for (int i = 0; i < totalCards; i++)
-                (i < half ? p1 : p2).addCardToDeck(cardPool[i]);
-        } else {
-            int p1count = 0;
-            for (int i = 0; i < totalCards; i++) {
-                if ((rand() % 2 == 0 && p1count < half) || (i - p1count) >= half) {
-                    p1.addCardToDeck(cardPool[i]);
-                    p1count++;
-                } else {
-                    p2.addCardToDeck(cardPool[i]);
-                }
-            }
-        }
-
-        clearScreen();
-        cout << GREEN << "Decks are ready!\n\n" << RESET;
-        cout << p1.getName() << " has " << p1.remainingCards() << " cards.\n";
-        cout << p2.getName() << " has " << p2.remainingCards() << " cards.\n";
-        waitForEnter();
-
-        roundNumber = 1;
-    }
-
-    // Show a player's deck
-    void printDeckList(const Player &pl) {
-        cout << CYAN << pl.getName() << "'s current deck:\n" << RESET;
-
-        queue<Card> temp = pl.getDeckSnapshot();
-        if (temp.empty()) {
-            cout << WHITE << "  [No cards]\n\n" << RESET;
-            return;
-        }
-
-        int index = 1;
-        while (!temp.empty()) {
-            cout << YELLOW << "  " << index++ << ". " << RESET;
-            temp.front().display();
-            cout << "\n";
-            temp.pop();
-        }
-        cout << "\n";
-    }
-
-    // Compare card powers
-    int compareCards(const Card &c1, const Card &c2) {
-        if (c1.getPower() > c2.getPower()) return 1;
-        if (c2.getPower() > c1.getPower()) return -1;
-        return 0;
-    }
-
-    // Play one round of the game
-    void playRound() {
-        if (!p1.hasCards() || !p2.hasCards()) {
-            cout << RED << "Cannot play round: one deck empty.\n" << RESET;
-            waitForEnter();
-            return;
-        }
-
-        clearScreen();
-        cout << CYAN << "========== ROUND " << roundNumber << " ==========\n\n" << RESET;
-
-        printDeckList(p1);
-        printDeckList(p2);
-
-        cout << YELLOW << "Press ENTER to draw cards..." << RESET;
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
-
-        Card c1 = p1.drawCard();
-        Card c2 = p2.drawCard();
-
-        cout << "\n" << GREEN << p1.getName() << " plays: " << RESET;
-        c1.display(); cout << "\n";
-
-        cout << GREEN << p2.getName() << " plays: " << RESET;
-        c2.display(); cout << "\n\n";
-
-        int res = compareCards(c1, c2);
-
-        if (res == 1) {
-            cout << GREEN << p1.getName() << " wins this round!\n" << RESET;
-            p1.addWinCards(c1, c2);
-        } else if (res == -1) {
-            cout << GREEN << p2.getName() << " wins this round!\n" << RESET;
-            p2.addWinCards(c1, c2);
-        } else {
-            cout << MAGENTA << "It's a draw. Each keeps their card.\n" << RESET;
-            p1.keepOwnCard(c1);
-            p2.keepOwnCard(c2);
-        }
-
-        cout << CYAN << "\nRemaining cards:\n" << RESET;
-        cout << p1.getName() << ": " << p1.remainingCards() << "\n";
-        cout << p2.getName() << ": " << p2.remainingCards() << "\n";
-
-        roundNumber++;
-        waitForEnter();
-    }
-
-    // Show current scores
-    void showScores() {
-        clearScreen();
-        cout << CYAN << "======== CURRENT SCORE ========\n" << RESET;
-        cout << p1.getName() << ": " << p1.getScore() << "\n";
-        cout << p2.getName() << ": " << p2.getScore() << "\n";
-        waitForEnter();
-    }
-
-    // Show remaining cards count
-    void showRemainingCards() {
-        clearScreen();
-        cout << CYAN << "==== REMAINING CARDS ====\n" << RESET;
-        cout << p1.getName() << ": " << p1.remainingCards() << "\n";
-        cout << p2.getName() << ": " << p2.remainingCards() << "\n";
-        waitForEnter();
-    }
-
-    // View player's deck menu
-    void viewDeckMenu() {
-        clearScreen();
-        if (vsComputer) {
-            printDeckList(p1);
-        } else {
-            int choice;
-            cout << CYAN << "Whose deck do you want to view?\n" << RESET;
-            cout << "1. " << p1.getName() << "\n";
-            cout << "2. " << p2.getName() << "\n";
-            cout << "Enter choice: ";
-            cin >> choice;
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-
-            if (choice == 1) printDeckList(p1);
-            else printDeckList(p2);
-        }
-        waitForEnter();
-    }
-
-    // Show the final winner
-    void showFinalResult() {
-        clearScreen();
-        int s1 = p1.getScore();
-        int s2 = p2.getScore();
-
-        cout << CYAN << "========== FINAL RESULT ==========" << RESET << "\n";
-        cout << p1.getName() << " score: " << s1 << "\n";
-        cout << p2.getName() << " score: " << s2 << "\n";
-
-        if (s1 > s2)
-            cout << GREEN << "\nWINNER: " << p1.getName() << " \n" << RESET;
-        else if (s2 > s1)
-            cout << GREEN << "\nWINNER: " << p2.getName() << " \n" << RESET;
-        else
-            cout << MAGENTA << "\nMATCH DRAW \n" << RESET;
-
-        waitForEnter();
-    }
-
-    // In-game menu loop
-    void gameLoop() {
-        while (true) {
-            if (!p1.hasCards() || !p2.hasCards()) {
-                showFinalResult();
-                break;
-            }
-
-            clearScreen();
-            cout << YELLOW << "======== GAME MENU ========\n";
-            cout << "1. Play Next Round\n";
-            cout << "2. View Scores\n";
-            cout << "3. View Remaining Cards\n";
-            cout << "4. View Deck\n";
-            cout << "0. End Game Now\n";
-            cout << "===========================\n";
-            cout << "Enter choice: " << RESET;
-
-            int ch;
-            cin >> ch;
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-
-            if (ch == 1) playRound();
-            else if (ch == 2) showScores();
-            else if (ch == 3) showRemainingCards();
-            else if (ch == 4) viewDeckMenu();
-            else if (ch == 0) {
-                showFinalResult();
-                break;
-            }
-        }
-    }
-
-    // Run a full game
-    void runSingleGame() {
-        chooseMode();
-        setupPlayers();
-
-        int totalCards, distMode;
-        askGameSettings(totalCards, distMode);
-
-        generateAndDistributeCards(totalCards, distMode);
-        gameLoop();
-    }
-
-    // Outer loop
-    void run() {
-        while (true) {
-            showTitleScreen();
-            int choice = showStartMenu();
-            if (choice == 0) {
-                clearScreen();
-                cout << GREEN << "Thanks for playing Card Battle Game!\n" << RESET;
-                break;
-            }
-            runSingleGame();
-        }
-    }
-};
-
-// ===============================
-// MAIN ENTRY POINT
-// ===============================
-
-int main() {
-    srand((unsigned)time(0)); // Seed RNG
-    Game game;
-    game.run();
-
-    cout << YELLOW << "\nPress any key to exit..." << RESET;
-    getch();
-    return 0;
-}
-
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <stack>
+#include <map>
+#include <set>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <ctime>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <functional>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <conio.h>
+#else
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#endif
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <filesystem>
+
+using namespace std;
+
+// ===============================
+// COLOR CODES (for console text colors)
+// ===============================
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define YELLOW  "\033[33m"
+#define BLUE    "\033[34m"
+#define MAGENTA "\033[35m"
+#define CYAN    "\033[36m"
+#define WHITE   "\033[37m"
+
+// ===============================
+// LATENCY HISTOGRAMS
+// ===============================
+
+// HDR-style histogram of microsecond values: exact below 1024, then 512
+// linear buckets per power of two, so every value is kept to within 0.2%
+// with a few thousand counters and no sample list.
+class LatencyHistogram {
+private:
+    static const int EXACT = 1024;
+    static const int PER_OCTAVE = 512;
+
+    vector<long long> counts;   // Grown on demand
+    long long total;
+    long long largest;
+
+    static int indexOf(long long us) {
+        if (us < EXACT) return (int)us;
+        int top = 63 - __builtin_clzll((unsigned long long)us);
+        int shift = top - 9;     // (us >> shift) is in [512, 1024)
+        return EXACT + (shift - 1) * PER_OCTAVE + (int)((us >> shift) - PER_OCTAVE);
+    }
+
+    // Largest value that falls into a bucket
+    static long long valueAt(int index) {
+        if (index < EXACT) return index;
+        int shift = (index - EXACT) / PER_OCTAVE + 1;
+        long long mantissa = (index - EXACT) % PER_OCTAVE + PER_OCTAVE;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() {
+        total = 0;
+        largest = 0;
+    }
+
+    void record(long long us) {
+        if (us < 0) us = 0;
+        if (us > (1LL << 40)) us = 1LL << 40;
+        int i = indexOf(us);
+        if ((int)counts.size() <= i) counts.resize(i + 1, 0);
+        counts[i]++;
+        total++;
+        largest = max(largest, us);
+    }
+
+    long long count() const { return total; }
+    long long maxValue() const { return largest; }
+
+    // Smallest recorded value with at least p percent of samples at or below it
+    long long percentile(double p) const {
+        if (total == 0) return 0;
+        long long need = (long long)ceil(p / 100.0 * total);
+        if (need < 1) need = 1;
+        long long seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= need) return min(valueAt((int)i), largest);
+        }
+        return largest;
+    }
+};
+
+// Input-to-screen latency per menu action: start() when the key arrives,
+// finish() once the resulting screen has been flushed and the game waits
+// for input again
+class LatencyRecorder {
+private:
+    map<string, LatencyHistogram> byAction;
+    string action;              // Empty when nothing is being timed
+    chrono::steady_clock::time_point began;
+
+public:
+    void start(const string &name) {
+        action = name;
+        began = chrono::steady_clock::now();
+    }
+
+    void finish() {
+        if (action.empty()) return;
+        cout.flush();
+        long long us = chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - began).count();
+        byAction[action].record(us);
+        action.clear();
+    }
+
+    bool empty() const { return byAction.empty(); }
+
+    void report(ostream &out) const {
+        out << "Input-to-screen latency (ms)  count       p50       p99      p999       max\n";
+        for (map<string, LatencyHistogram>::const_iterator it = byAction.begin(); it != byAction.end(); ++it) {
+            const LatencyHistogram &h = it->second;
+            char row[160];
+            snprintf(row, sizeof(row), "%-28.28s %6lld %9.3f %9.3f %9.3f %9.3f\n", it->first.c_str(), h.count(),
+                     h.percentile(50) / 1000.0, h.percentile(99) / 1000.0,
+                     h.percentile(99.9) / 1000.0, h.maxValue() / 1000.0);
+            out << row;
+        }
+    }
+};
+
+LatencyRecorder &latency() {
+    static LatencyRecorder instance;
+    return instance;
+}
+
+// ===============================
+// TERMINAL BACKEND
+// ===============================
+
+// Screen and keyboard access. Colors and screen clears are ANSI escapes
+// written through cout, so they sit in the same buffer as the text and
+// reach the terminal in one write per flush instead of one call each.
+class Terminal {
+public:
+    virtual ~Terminal() {}
+    virtual void clearScreen() = 0;
+    virtual int readKey() = 0;      // One key press, not echoed
+    virtual int rows() = 0;         // Screen height, 0 if unknown
+};
+
+#ifdef _WIN32
+class ConsoleTerminal : public Terminal {
+public:
+    void clearScreen() { cout << "\033[2J\033[H"; }
+
+    int readKey() {
+        cout.flush();
+        return getch();
+    }
+
+    int rows() { return 0; }
+};
+#else
+class PosixTerminal : public Terminal {
+public:
+    void clearScreen() { cout << "\033[2J\033[H"; }
+
+    // Raw mode for just this read, so line input keeps working elsewhere
+    int readKey() {
+        cout.flush();
+        termios saved;
+        if (tcgetattr(STDIN_FILENO, &saved) != 0) return getchar();  // Not a tty
+
+        termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        int key = getchar();
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+        return key;
+    }
+
+    int rows() {
+        winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0) return 0;
+        return ws.ws_row;
+    }
+};
+#endif
+
+Terminal &terminal() {
+#ifdef _WIN32
+    static ConsoleTerminal instance;
+#else
+    static PosixTerminal instance;
+#endif
+    return instance;
+}
+
+// Draws a screen given as lines, sending only the lines that differ from
+// the last frame. Prompts and typed input land below a frame's last line,
+// so that line and everything under it is always redrawn. A frame taller
+// than the terminal is redrawn in full, because scrolling would move the
+// lines under the renderer.
+class FrameRenderer {
+private:
+    vector<string> shown;   // Lines on screen now
+    bool valid;             // False once something else drew on the screen
+
+public:
+    FrameRenderer() {
+        valid = false;
+    }
+
+    void invalidate() { valid = false; }
+
+    void present(const vector<string> &lines) {
+        int height = terminal().rows();
+        if (height > 0 && (int)lines.size() >= height) valid = false;
+
+        string out;
+        size_t intact = 0;
+        if (valid) intact = shown.empty() ? 0 : shown.size() - 1;
+        else out = "\033[2J";
+
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (i < intact && shown[i] == lines[i]) continue;
+            char move[24];
+            snprintf(move, sizeof(move), "\033[%d;1H", (int)i + 1);
+            out += move + lines[i] + "\033[K";
+        }
+        out += "\033[J";    // Cursor ends on the last line; clear what is below
+
+        cout << out << flush;
+        shown = lines;
+        valid = true;
+        latency().finish();
+    }
+};
+
+FrameRenderer &screen() {
+    static FrameRenderer instance;
+    return instance;
+}
+
+// ===============================
+// SCRIPTED INPUT
+// ===============================
+
+// Input sources plug in under cin as stream buffers, one line at a time,
+// so every prompt in the game reads from them unchanged.
+class InputSource : public streambuf {
+private:
+    string line;
+
+protected:
+    // Next line including its '\n'; false when there is no more input
+    virtual bool nextLine(string &text) = 0;
+
+    int underflow() {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (!nextLine(line) || line.empty()) return traits_type::eof();
+        setg(&line[0], &line[0], &line[0] + line.size());
+        return traits_type::to_int_type(*gptr());
+    }
+};
+
+// Passes the keyboard through and appends every line to a keystroke file
+class RecordingInput : public InputSource {
+private:
+    streambuf *source;
+    ofstream out;
+
+protected:
+    bool nextLine(string &text) {
+        text.clear();
+        int c;
+        while ((c = source->sbumpc()) != EOF) {
+            text += (char)c;
+            if (c == '\n') break;
+        }
+        out << text << flush;
+        return !text.empty();
+    }
+
+public:
+    RecordingInput(streambuf *keyboard, const string &path) : out(path.c_str(), ios::binary) {
+        source = keyboard;
+    }
+
+    bool ok() const { return out.good(); }
+};
+
+// Keeps what the game printed since the last input, so a screen can be
+// named, and passes it on to a capture file (or drops it)
+class OutputCapture : public streambuf {
+private:
+    streambuf *target;    // 0 = discard
+    string recent;
+
+protected:
+    int overflow(int c) {
+        if (c == EOF) return 0;
+        recent += (char)c;
+        return target ? target->sputc((char)c) : c;
+    }
+
+    streamsize xsputn(const char *s, streamsize n) {
+        recent.append(s, (size_t)n);
+        if (recent.size() > (1u << 16)) recent.erase(0, recent.size() - (1u << 15));
+        return target ? target->sputn(s, n) : n;
+    }
+
+    int sync() { return target ? target->pubsync() : 0; }
+
+public:
+    OutputCapture(streambuf *t) { target = t; }
+
+    // Screen name: its last "=== TITLE ===" line, or else its last line, with
+    // ANSI codes dropped and digits folded to '#' so rounds share one name
+    string screenName() {
+        vector<string> lines(1);
+        for (size_t i = 0; i < recent.size(); i++) {
+            char ch = recent[i];
+            if (ch == '\033' && i + 1 < recent.size() && recent[i + 1] == '[') {
+                size_t j = i + 2;
+                while (j < recent.size() && !isalpha((unsigned char)recent[j])) j++;
+                if (j < recent.size() && (recent[j] == 'H' || recent[j] == 'J')) lines.push_back("");
+                i = j;
+            } else if (ch == '\n' || ch == '\r') {
+                lines.push_back("");
+            } else if (isdigit((unsigned char)ch)) {
+                if (lines.back().empty() || lines.back()[lines.back().size() - 1] != '#') lines.back() += '#';
+            } else {
+                lines.back() += ch;
+            }
+        }
+
+        string title, last;
+        for (size_t i = 0; i < lines.size(); i++) {
+            string t = lines[i];
+            size_t a = t.find_first_not_of("= "), b = t.find_last_not_of("= ");
+            if (a == string::npos) continue;
+            if (t.find("===") != string::npos) title = t.substr(a, b - a + 1);
+            last = t.substr(a, b - a + 1);
+        }
+        recent.clear();
+        return title.empty() ? last : title;
+    }
+};
+
+// Feeds a keystroke file to the game line by line. The time from handing
+// over a line to the game asking for the next one is that screen's latency.
+// When the script runs out it throws ScriptEnded through cin, which needs
+// cin.exceptions(ios::badbit), so the game unwinds instead of spinning.
+struct ScriptEnded {};
+
+class ScriptedInput : public InputSource {
+private:
+    vector<string> script;
+    size_t next;
+    OutputCapture &capture;
+    chrono::steady_clock::time_point handedOver;
+    map<string, LatencyHistogram> stats;
+
+protected:
+    bool nextLine(string &text) {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        string screen = capture.screenName();
+        if (next > 0)
+            stats[screen].record(chrono::duration_cast<chrono::microseconds>(now - handedOver).count());
+        if (next >= script.size()) throw ScriptEnded();
+
+        text = script[next++];
+        handedOver = chrono::steady_clock::now();
+        return true;
+    }
+
+public:
+    ScriptedInput(OutputCapture &out) : capture(out) { next = 0; }
+
+    bool load(const string &path) {
+        ifstream in(path.c_str(), ios::binary);
+        if (!in) return false;
+        string line;
+        while (getline(in, line)) script.push_back(line + "\n");
+        return true;
+    }
+
+    size_t linesUsed() const { return next; }
+
+    void report(ostream &out) const {
+        out << "Screen                                    count    p50 ms    p99 ms    max ms\n";
+        for (map<string, LatencyHistogram>::const_iterator it = stats.begin(); it != stats.end(); ++it) {
+            const LatencyHistogram &h = it->second;
+            char row[160];
+            snprintf(row, sizeof(row), "%-40.40s %7lld %9.3f %9.3f %9.3f\n", it->first.c_str(), h.count(),
+                     h.percentile(50) / 1000.0, h.percentile(99) / 1000.0, h.maxValue() / 1000.0);
+            out << row;
+        }
+    }
+};
+
+// ===============================
+// HELPER FUNCTIONS
+// ===============================
+
+// Clear the screen
+void clearScreen() {
+    terminal().clearScreen();
+    screen().invalidate();
+}
+
+// Wait for user to press enter
+void waitForEnter() {
+    cout << YELLOW << "\nPress ENTER to continue..." << RESET;
+    latency().finish();
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+}
+
+// Convert integer to string
+string intToString(int x) {
+    stringstream ss;
+    ss << x;
+    return ss.str();
+}
+
+// ===============================
+// CARD CLASS
+// ===============================
+
+const int MAX_POWER = 1000;  // Highest power a rarity setting allows
+
+// Represents a single card with name, power, and rarity
+class Card {
+private:
+    string name;
+    int power;
+    string rarity;
+
+public:
+    // Default constructor
+    Card() {
+        name = "Unknown";
+        power = 0;
+        rarity = "Common";
+    }
+
+    // Parameterized constructor
+    Card(string n, int p, string r) {
+        name = n;
+        power = p;
+        rarity = r;
+    }
+
+    // Getters
+    string getName() const { return name; }
+    int getPower() const { return power; }
+    const string &getRarity() const { return rarity; }
+
+    // Rarity colors for display
+    string rarityColor() const {
+        if (rarity == "Legendary") return RED;
+        if (rarity == "Epic") return MAGENTA;
+        if (rarity == "Rare") return BLUE;
+        return WHITE;
+    }
+
+    // Card info with its rarity color
+    string describe() const {
+        return rarityColor() + name + " (" + rarity + " | Power: " + intToString(power) + ")" + RESET;
+    }
+
+    // Display card info
+    void display() const {
+        cout << describe();
+    }
+};
+
+// Convert power to rarity
+string rarityForPower(int power) {
+    if (power >= 90) return "Legendary";
+    if (power >= 70) return "Epic";
+    if (power >= 50) return "Rare";
+    return "Common";
+}
+
+// Rarities, weakest first
+const char *const RARITY_NAMES[4] = { "Common", "Rare", "Epic", "Legendary" };
+
+// Position of a rarity in RARITY_NAMES
+int rarityTier(const string &rarity) {
+    int tier = 0;
+    while (tier < 3 && rarity != RARITY_NAMES[tier]) tier++;
+    return tier;
+}
+
+// How often each rarity is dealt (relative integer weights) and the power
+// range of each. The defaults deal exactly like the original game: power
+// uniform in 10-100, named by the rarityForPower thresholds.
+struct RaritySettings {
+    int weight[4];
+    int low[4], high[4];
+
+    RaritySettings() {
+        const int w[4] = { 40, 20, 20, 11 }, lo[4] = { 10, 50, 70, 90 }, hi[4] = { 49, 69, 89, 100 };
+        for (int i = 0; i < 4; i++) {
+            weight[i] = w[i];
+            low[i] = lo[i];
+            high[i] = hi[i];
+        }
+    }
+
+    bool valid() const {
+        int total = 0;
+        for (int i = 0; i < 4; i++) {
+            if (weight[i] < 0 || low[i] < 1 || low[i] > high[i] || high[i] > 1000) return false;
+            total += weight[i];
+        }
+        return total > 0;
+    }
+};
+
+// Vose's alias method: O(k) setup, then every draw is one pick of a column
+// and one biased coin, whatever the weights are
+class AliasSampler {
+private:
+    vector<uint64_t> keep;   // Keep the column if a 32-bit draw is below this
+    vector<int> alias;       // Otherwise take this outcome
+
+public:
+    AliasSampler(const vector<double> &weights) {
+        int n = (int)weights.size();
+        keep.assign(n, 1ULL << 32);
+        alias.assign(n, 0);
+
+        double total = 0;
+        for (int i = 0; i < n; i++) total += weights[i];
+        vector<double> scaled(n);
+        vector<int> small, large;
+        for (int i = 0; i < n; i++) {
+            scaled[i] = weights[i] * n / total;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+
+        // Fill each light column up with a share of a heavy one
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            keep[s] = (uint64_t)(scaled[s] * 4294967296.0);
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Leftovers are 1 up to rounding and keep their column
+    }
+
+    int sample(mt19937 &rng) const {
+        int column = (int)(((uint64_t)rng() * keep.size()) >> 32);
+        return rng() < keep[column] ? column : alias[column];
+    }
+};
+
+// Draws (rarity, power) pairs for a whole pool in one pass over flat arrays
+class CardGenerator {
+private:
+    AliasSampler sampler;
+    int low[4];
+    uint64_t span[4];
+
+    static vector<double> weightsOf(const RaritySettings &rs) {
+        return vector<double>(rs.weight, rs.weight + 4);
+    }
+
+public:
+    CardGenerator(const RaritySettings &rs) : sampler(weightsOf(rs)) {
+        for (int i = 0; i < 4; i++) {
+            low[i] = rs.low[i];
+            span[i] = (uint64_t)(rs.high[i] - rs.low[i] + 1);
+        }
+    }
+
+    void fill(int count, mt19937 &rng, vector<unsigned char> &rarity, vector<int> &power) const {
+        rarity.resize(count);
+        power.resize(count);
+        for (int i = 0; i < count; i++) {
+            int r = sampler.sample(rng);
+            rarity[i] = (unsigned char)r;
+            power[i] = low[r] + (int)(((uint64_t)rng() * span[r]) >> 32);
+        }
+    }
+};
+
+// Random cards in random order; safe to call from worker threads
+vector<Card> makeCardPool(int totalCards, mt19937 &rng, const RaritySettings &rs = RaritySettings()) {
+    static const char *baseNames[] = {
+        "Knight", "Dragon", "Wizard", "Archer", "Assassin",
+        "Golem", "Hunter", "Paladin", "Samurai", "Mage"
+    };
+
+    vector<unsigned char> rarity;
+    vector<int> power;
+    CardGenerator(rs).fill(totalCards, rng, rarity, power);
+
+    vector<Card> pool;
+    pool.reserve(totalCards);
+    for (int i = 0; i < totalCards; ++i) {
+        string nm = string(baseNames[i % 10]) + " #" + intToString(i + 1);
+        pool.push_back(Card(nm, power[i], RARITY_NAMES[rarity[i]]));
+    }
+
+    shuffle(pool.begin(), pool.end(), rng);
+    return pool;
+}
+
+// ===============================
+// PERSISTENT STRUCTURES
+// ===============================
+
+// Immutable list cell. Every version of a stack or queue is a pointer into
+// shared cells, so keeping an old version costs nothing extra. The count
+// is a plain int: a player and all its saved versions stay on one thread
+// at a time, and this keeps a push at one allocation with no atomics.
+template <class T>
+struct ListCell {
+    T value;
+    ListCell *next;
+    int refs;
+
+    ListCell(const T &v, ListCell *n) : value(v), next(n), refs(1) {
+        if (next) next->refs++;
+    }
+};
+
+// Persistent stack: push and pop return a new version in O(1)
+template <class T>
+class PersistentStack {
+private:
+    ListCell<T> *head;
+    int count;
+
+    PersistentStack(ListCell<T> *h, int n) : head(h), count(n) {
+        if (head) head->refs++;
+    }
+
+    // Drop a reference; cells nobody else points to are freed in a loop,
+    // so a long deck cannot run out of stack
+    static void release(ListCell<T> *c) {
+        while (c && --c->refs == 0) {
+            ListCell<T> *next = c->next;
+            delete c;
+            c = next;
+        }
+    }
+
+public:
+    PersistentStack() : head(0), count(0) {}
+
+    PersistentStack(const PersistentStack &o) : head(o.head), count(o.count) {
+        if (head) head->refs++;
+    }
+
+    PersistentStack &operator=(const PersistentStack &o) {
+        if (o.head) o.head->refs++;
+        release(head);
+        head = o.head;
+        count = o.count;
+        return *this;
+    }
+
+    ~PersistentStack() { release(head); }
+
+    bool empty() const { return count == 0; }
+    int size() const { return count; }
+    const T &top() const { return head->value; }
+
+    PersistentStack push(const T &v) const {
+        ListCell<T> *cell = new ListCell<T>(v, head);
+        PersistentStack s(cell, count + 1);
+        cell->refs--;     // Owned by s alone
+        return s;
+    }
+
+    PersistentStack pop() const { return PersistentStack(head->next, count - 1); }
+
+    PersistentStack reversed() const {
+        PersistentStack r;
+        for (const ListCell<T> *c = head; c; c = c->next) r = r.push(c->value);
+        return r;
+    }
+
+    // Up to `limit` values, top first
+    vector<T> toVector(int limit) const {
+        vector<T> out;
+        for (const ListCell<T> *c = head; c && (int)out.size() < limit; c = c->next)
+            out.push_back(c->value);
+        return out;
+    }
+};
+
+// Persistent queue as a front stack plus a reversed back stack (Okasaki).
+// The front is only empty when the whole queue is, so front() is O(1);
+// when a pop empties it, the back stack is reversed into a new front.
+// That reversal builds new cells and leaves older versions untouched.
+template <class T>
+class PersistentQueue {
+private:
+    PersistentStack<T> front_, back_;
+
+    PersistentQueue(const PersistentStack<T> &f, const PersistentStack<T> &b) : front_(f), back_(b) {}
+
+public:
+    PersistentQueue() {}
+
+    // Queue holding `values` in order, built straight into the front stack
+    static PersistentQueue fromVector(const vector<T> &values) {
+        PersistentStack<T> f;
+        for (int i = (int)values.size() - 1; i >= 0; i--) f = f.push(values[i]);
+        return PersistentQueue(f, PersistentStack<T>());
+    }
+
+    bool empty() const { return front_.empty(); }
+    int size() const { return front_.size() + back_.size(); }
+    const T &front() const { return front_.top(); }
+
+    PersistentQueue push(const T &v) const {
+        if (front_.empty()) return PersistentQueue(front_.push(v), back_);
+        return PersistentQueue(front_, back_.push(v));
+    }
+
+    PersistentQueue pop() const {
+        PersistentStack<T> f = front_.pop();
+        if (!f.empty()) return PersistentQueue(f, back_);
+        return PersistentQueue(back_.reversed(), PersistentStack<T>());
+    }
+
+    // Up to `limit` values in queue order
+    vector<T> toVector(int limit) const {
+        vector<T> out = front_.toVector(limit);
+        if ((int)out.size() < limit && !back_.empty()) {
+            vector<T> rest = back_.toVector(back_.size());
+            for (int i = (int)rest.size() - 1; i >= 0 && (int)out.size() < limit; i--)
+                out.push_back(rest[i]);
+        }
+        return out;
+    }
+};
+
+// ===============================
+// PLAYER CLASS
+// ===============================
+
+// A player's deck and won pile at one moment; O(1) to take and to restore
+struct PlayerState {
+    PersistentQueue<Card> deck;
+    PersistentStack<Card> discard;
+};
+
+class Player {
+private:
+    string name;
+    PersistentQueue<Card> deck;     // Cards to draw
+    PersistentStack<Card> discard;  // Cards won
+    // Hand mode: cards bucketed by power, plus a Fenwick tree over the bucket
+    // sizes, so the card at a position of the hand sorted by power is found
+    // and removed in O(log MAX_POWER). Buckets are made on the first card.
+    vector<vector<Card> > hand;
+    vector<int> handTree;
+    vector<int> handCounts;  // Cards per power, for the computer's search
+    int handTotal;
+
+    void handAdd(int power, int delta) {
+        handTotal += delta;
+        handCounts[power] += delta;
+        for (int i = power + 1; i < (int)handTree.size(); i += i & -i) handTree[i] += delta;
+    }
+
+    // Power of the card at 0-based position `index`; `index` becomes its
+    // place in that power's bucket
+    int handLocate(int &index) const {
+        int power = 0;
+        for (int step = 1024; step > 0; step >>= 1) {
+            if (power + step < (int)handTree.size() && handTree[power + step] <= index) {
+                power += step;
+                index -= handTree[power];
+            }
+        }
+        return power;
+    }
+
+public:
+    Player(string n = "Player") {
+        name = n;
+        handTotal = 0;
+    }
+
+    // Set / get name
+    void setName(string n) { name = n; }
+    string getName() const { return name; }
+
+    // Add card to player's deck
+    void addCardToDeck(const Card &c) { deck = deck.push(c); }
+
+    // Replace the deck in one go; cheaper than adding card by card
+    void setDeck(const vector<Card> &cards) { deck = PersistentQueue<Card>::fromVector(cards); }
+
+    // Check if player still has cards
+    bool hasCards() const { return !deck.empty() || handTotal > 0; }
+
+    // Remaining cards count
+    int remainingCards() const { return (int)deck.size() + handTotal; }
+
+    // Draw top card
+    Card drawCard() {
+        Card c = deck.front();
+        deck = deck.pop();
+        return c;
+    }
+
+    // Power of the top card without drawing it
+    int peekPower() const { return deck.front().getPower(); }
+
+    // Player wins round and takes both cards
+    void addWinCards(const Card &c1, const Card &c2) {
+        discard = discard.push(c1).push(c2);
+    }
+
+    // Player wins a multiplayer round and takes every card played
+    void addWinCards(const vector<Card> &cards) {
+        for (size_t i = 0; i < cards.size(); i++) discard = discard.push(cards[i]);
+    }
+
+    // Draw result is tie
+    void keepOwnCard(const Card &c) {
+        discard = discard.push(c);
+    }
+
+    // Score is total cards in discard
+    int getScore() const { return discard.size(); }
+
+    // Copy deck for viewing
+    queue<Card> getDeckSnapshot() const {
+        vector<Card> cards = deck.toVector(deck.size());
+        return queue<Card>(deque<Card>(cards.begin(), cards.end()));
+    }
+
+    // The next `count` cards to be drawn
+    vector<Card> peekDeck(int count) const {
+        return deck.toVector(count);
+    }
+
+    // Copy discard pile, bottom card first
+    vector<Card> getDiscardSnapshot() const {
+        vector<Card> cards = discard.toVector(discard.size());
+        reverse(cards.begin(), cards.end());
+        return cards;
+    }
+
+    // Deck and won pile, shared with the player rather than copied
+    PlayerState saveState() const {
+        PlayerState st;
+        st.deck = deck;
+        st.discard = discard;
+        return st;
+    }
+
+    void restoreState(const PlayerState &st) {
+        deck = st.deck;
+        discard = st.discard;
+    }
+
+    // Restoring a saved game: put a card straight into the hand
+    void addCardToHand(const Card &c) {
+        if (hand.empty()) {
+            hand.resize(MAX_POWER + 1);
+            handTree.assign(MAX_POWER + 2, 0);
+            handCounts.assign(MAX_POWER + 1, 0);
+        }
+        hand[c.getPower()].push_back(c);
+        handAdd(c.getPower(), 1);
+    }
+
+    // Hand mode: pick up the whole deck into the hand
+    void moveDeckToHand() {
+        while (!deck.empty()) {
+            addCardToHand(deck.front());
+            deck = deck.pop();
+        }
+    }
+
+    // Hand mode: play the card at a position of the sorted hand (0-based).
+    // The last card of its power takes its place, so cards of equal power
+    // do not keep their order.
+    Card playFromHand(int index) {
+        int power = handLocate(index);
+        vector<Card> &bucket = hand[power];
+        Card c = bucket[index];
+        bucket[index] = bucket.back();
+        bucket.pop_back();
+        handAdd(power, -1);
+        return c;
+    }
+
+    int handSize() const { return handTotal; }
+
+    // Hand mode: `count` cards of the sorted hand from position `first`
+    vector<Card> handSlice(int first, int count) const {
+        vector<Card> cards;
+        if (first >= handTotal) return cards;
+        int at = first;
+        for (int power = handLocate(at); power <= MAX_POWER && (int)cards.size() < count; power++, at = 0)
+            for (size_t i = at; i < hand[power].size() && (int)cards.size() < count; i++)
+                cards.push_back(hand[power][i]);
+        return cards;
+    }
+
+    // Hand mode: is there a card with this power in the hand?
+    bool holdsPower(int power) const {
+        return power >= 0 && power < (int)hand.size() && !hand[power].empty();
+    }
+
+    // Hand mode: play any card with the given power, O(log MAX_POWER)
+    Card playFromHandByPower(int power) {
+        Card c = hand[power].back();
+        hand[power].pop_back();
+        handAdd(power, -1);
+        return c;
+    }
+
+    // Cards held per power, kept up to date on every play; empty until the
+    // first card reaches the hand
+    const vector<int> &getHandCounts() const { return handCounts; }
+
+    // Powers in hand, ascending
+    vector<int> getHandPowers() const {
+        vector<int> powers;
+        powers.reserve(handTotal);
+        for (size_t p = 0; p < hand.size(); p++) powers.insert(powers.end(), hand[p].size(), (int)p);
+        return powers;
+    }
+
+    // Copy hand for viewing, ascending by power
+    vector<Card> getHandSnapshot() const {
+        vector<Card> cards;
+        cards.reserve(handTotal);
+        for (size_t p = 0; p < hand.size(); p++) cards.insert(cards.end(), hand[p].begin(), hand[p].end());
+        return cards;
+    }
+};
+
+// ===============================
+// THREAD POOL
+// ===============================
+
+// Fixed set of worker threads fed from a shared task queue
+class ThreadPool {
+private:
+    vector<thread> workers;
+    queue<function<void()> > tasks;
+    mutex m;
+    condition_variable taskReady;
+    condition_variable allDone;
+    int busy;
+    bool stopping;
+
+    void workerLoop() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(m);
+                taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = tasks.front();
+                tasks.pop();
+                busy++;
+            }
+
+            task();
+
+            unique_lock<mutex> lock(m);
+            busy--;
+            if (busy == 0 && tasks.empty()) allDone.notify_all();
+        }
+    }
+
+public:
+    // 0 threads means one per hardware core
+    ThreadPool(int n = 0) {
+        busy = 0;
+        stopping = false;
+        if (n <= 0) n = (int)thread::hardware_concurrency();
+        if (n <= 0) n = 2;
+        for (int i = 0; i < n; i++)
+            workers.push_back(thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        taskReady.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    }
+
+    int size() const { return (int)workers.size(); }
+
+    void submit(function<void()> task) {
+        {
+            lock_guard<mutex> lock(m);
+            tasks.push(task);
+        }
+        taskReady.notify_one();
+    }
+
+    // Block until the queue is empty and every worker is idle
+    void waitIdle() {
+        unique_lock<mutex> lock(m);
+        allDone.wait(lock, [this] { return busy == 0 && tasks.empty(); });
+    }
+};
+
+// One pool for the whole process, started the first time something needs
+// it, so a game that never searches or runs a tournament starts no threads
+ThreadPool &workerPool() {
+    static ThreadPool instance;
+    return instance;
+}
+
+// ===============================
+// COMPUTER AI
+// ===============================
+
+// Tian Ji horse-racing matching for the open-hand mode.
+// Both hands are visible, the human plays first and the computer answers.
+// Scoring is +2 for a win and +1 for a draw, so maximizing our score is the
+// classic "wins minus losses" objective. The greedy two-pointer matching over
+// both sorted hands is optimal, and because the computer answers after seeing
+// the card, following that matching is optimal however the human orders play.
+// The plan is built once per deal in O(n log n); each answer is O(log n).
+class TianJiPlanner {
+private:
+    multimap<int, int> plan; // opponent power -> our answering power
+
+public:
+    void build(vector<int> ours, vector<int> theirs) {
+        plan.clear();
+        sort(ours.begin(), ours.end());
+        sort(theirs.begin(), theirs.end());
+
+        int ol = 0, oh = (int)ours.size() - 1;   // our slowest / fastest
+        int tl = 0, th = (int)theirs.size() - 1; // their slowest / fastest
+
+        while (ol <= oh && tl <= th) {
+            if (ours[oh] > theirs[th]) {
+                // Our fastest beats their fastest
+                plan.insert(make_pair(theirs[th--], ours[oh--]));
+            } else if (ours[oh] < theirs[th]) {
+                // Their fastest is unbeatable: sacrifice our slowest
+                plan.insert(make_pair(theirs[th--], ours[ol++]));
+            } else if (ours[ol] > theirs[tl]) {
+                // Fastest are equal: win cheaply with our slowest if we can
+                plan.insert(make_pair(theirs[tl++], ours[ol++]));
+            } else {
+                // Otherwise our slowest takes on their fastest (draw or loss)
+                plan.insert(make_pair(theirs[th--], ours[ol++]));
+            }
+        }
+    }
+
+    bool empty() const { return plan.empty(); }
+
+    // Power of the card to answer with, and remove that pairing
+    int respond(int opponentPower) {
+        multimap<int, int>::iterator it = plan.find(opponentPower);
+        int answer = it->second;
+        plan.erase(it);
+        return answer;
+    }
+};
+
+// Monte Carlo Tree Search for the hidden-hand mode.
+// The computer commits a card before seeing the human's card. The human's
+// hand contents follow from the card pool, but not the order they will be
+// played in, so the human's cards are chance moves sampled at random.
+// The root has one child per distinct power in our hand. Below a child, each
+// card the human may answer with gets a node, made on its first visit, whose
+// children are our next card; UCB1 picks moves at both of our plies and the
+// rounds after that are played out at random. All workers of the pool share
+// the tree until the time budget runs out. Node statistics are plain atomics,
+// a node is published with a compare-and-swap, and a worker adds a virtual
+// loss to the moves it is exploring so the others spread out.
+class MctsPlanner {
+private:
+    struct Node {
+        int power;
+        atomic<long long> visits;
+        atomic<long long> reward;      // Sum of rewards, fixed point
+        atomic<int> virtualLoss;       // Rollouts in flight through this node
+    };
+
+    // Our second card, after our first card and the human's answer to it
+    struct Reply {
+        atomic<long long> visits;
+        vector<Node> next;             // Same powers as the root's children
+
+        Reply(const vector<Node> &root) : visits(0), next(root.size()) {
+            for (size_t i = 0; i < root.size(); i++) next[i].power = root[i].power;
+        }
+    };
+
+    static const long long SCALE = 1000000;
+    static const long long TREE_NODES = 1 << 20;  // Second-ply nodes per move, ~24 MB
+
+    int budgetMs;      // Thinking time per move
+    int rolloutDepth;  // Rounds simulated after the chosen card
+
+    // Hands are counts per distinct power, so copying one for a rollout is
+    // cheap no matter how many cards are held
+    struct Hist {
+        vector<int> count;
+        int total;
+    };
+
+    static void take(Hist &h, int i) {
+        h.count[i]--;
+        h.total--;
+    }
+
+    static int sample(Hist &h, mt19937 &rng) {
+        int r = (int)(rng() % (unsigned)h.total);
+        int i = 0;
+        while (r >= h.count[i]) r -= h.count[i++];
+        take(h, i);
+        return i;
+    }
+
+    static int score(int mine, int other) { return mine > other ? 2 : (mine < other ? -2 : 0); }
+
+    // Play out the remaining rounds at random; returns reward in [0, 1] for the computer
+    double playout(Hist &a, Hist &b, int diff, int rounds, const vector<int> &values, mt19937 &rng) const {
+        while (a.total > 0 && b.total > 0 && rounds <= rolloutDepth) {
+            int mine = sample(a, rng);
+            diff += score(values[mine], values[sample(b, rng)]);
+            rounds++;
+        }
+        return (diff / (2.0 * rounds) + 1.0) / 2.0;
+    }
+
+    // UCB1 over the moves whose power is still in `hand`
+    static int selectChild(vector<Node> &children, const vector<int> &childIndex,
+                           const Hist &hand, long long parentVisits) {
+        double logN = log((double)parentVisits + 1.0);
+        int best = -1;
+        double bestScore = -1.0;
+        for (size_t i = 0; i < children.size(); i++) {
+            if (hand.count[childIndex[i]] == 0) continue;
+            long long n = children[i].visits.load() + children[i].virtualLoss.load();
+            if (n == 0) return (int)i;
+            double mean = (double)children[i].reward.load() / SCALE / n;
+            double ucb = mean + 1.4 * sqrt(logN / n);
+            if (ucb > bestScore) {
+                bestScore = ucb;
+                best = (int)i;
+            }
+        }
+        return best;
+    }
+
+    // The node in `slot`, made now if the tree still has room
+    static Reply *expand(atomic<Reply *> &slot, const vector<Node> &root, atomic<long long> &room) {
+        Reply *r = slot.load();
+        if (r || room.fetch_sub((long long)root.size()) < (long long)root.size()) return r;
+        Reply *fresh = new Reply(root);
+        if (slot.compare_exchange_strong(r, fresh)) return fresh;
+        delete fresh;
+        return r;
+    }
+
+    static void record(Node &n, double r) {
+        n.reward += (long long)(r * SCALE);
+        n.visits++;
+        n.virtualLoss--;
+    }
+
+public:
+    MctsPlanner(int budget = 200, int depth = 32) {
+        budgetMs = budget;
+        rolloutDepth = depth;
+    }
+
+    void setBudgetMs(int ms) { budgetMs = ms; }
+    int getBudgetMs() const { return budgetMs; }
+
+    // Power of the card the computer should commit, given both hands as
+    // cards per power. The budget covers the whole call.
+    int choose(const vector<int> &ourCounts, const vector<int> &theirCounts) {
+        chrono::steady_clock::time_point deadline =
+            chrono::steady_clock::now() + chrono::milliseconds(budgetMs);
+
+        // Compress powers to indices shared by both hands
+        vector<int> values;
+        Hist ours, theirs;
+        ours.total = theirs.total = 0;
+        for (size_t p = 0; p < max(ourCounts.size(), theirCounts.size()); p++) {
+            int a = p < ourCounts.size() ? ourCounts[p] : 0;
+            int b = p < theirCounts.size() ? theirCounts[p] : 0;
+            if (a + b == 0) continue;
+            values.push_back((int)p);
+            ours.count.push_back(a);
+            theirs.count.push_back(b);
+            ours.total += a;
+            theirs.total += b;
+        }
+
+        vector<Node> children;
+        vector<int> childIndex;
+        for (size_t i = 0; i < values.size(); i++)
+            if (ours.count[i] > 0) childIndex.push_back((int)i);
+        children = vector<Node>(childIndex.size());
+        for (size_t i = 0; i < children.size(); i++) {
+            children[i].power = values[childIndex[i]];
+            children[i].visits = 0;
+            children[i].reward = 0;
+            children[i].virtualLoss = 0;
+        }
+        if (children.size() == 1) return children[0].power;
+
+        // Slot [child * values + answer] holds that second-ply node once made
+        vector<atomic<Reply *> > replies(children.size() * values.size());
+        atomic<long long> room(TREE_NODES);
+        atomic<long long> rootVisits(0);
+
+        ThreadPool &pool = workerPool();
+        for (int w = 0; w < pool.size(); w++) {
+            unsigned seed = (unsigned)(rand() ^ (w * 7919));
+            pool.submit([&, seed] {
+                mt19937 rng(seed);
+                while (chrono::steady_clock::now() < deadline) {
+                    for (int k = 0; k < 64; k++) {
+                        int c = selectChild(children, childIndex, ours, rootVisits.load());
+                        children[c].virtualLoss++;
+                        Hist a = ours, b = theirs;
+                        take(a, childIndex[c]);
+                        int answer = sample(b, rng);
+                        int diff = score(children[c].power, values[answer]), rounds = 1;
+
+                        Reply *reply = 0;
+                        int m = -1;
+                        if (a.total > 0 && b.total > 0)
+                            reply = expand(replies[c * values.size() + answer], children, room);
+                        if (reply) {
+                            m = selectChild(reply->next, childIndex, a, reply->visits.load());
+                            reply->next[m].virtualLoss++;
+                            take(a, childIndex[m]);
+                            diff += score(reply->next[m].power, values[sample(b, rng)]);
+                            rounds++;
+                        }
+
+                        double r = playout(a, b, diff, rounds, values, rng);
+                        if (reply) {
+                            record(reply->next[m], r);
+                            reply->visits++;
+                        }
+                        record(children[c], r);
+                        rootVisits++;
+                    }
+                }
+            });
+        }
+        pool.waitIdle();
+        for (size_t i = 0; i < replies.size(); i++) delete replies[i].load();
+
+        // Most visited child is the most robust choice
+        int best = 0;
+        for (size_t i = 1; i < children.size(); i++)
+            if (children[i].visits > children[best].visits) best = (int)i;
+        return children[best].power;
+    }
+};
+
+// Exact expectimax solver for the hidden-hand mode on small decks.
+// The human's blind pick is a chance node (every card in hand equally
+// likely) and the computer maximizes the expected final score difference.
+// A state is two bitmasks over the hands sorted at deal time; equal powers
+// always leave from the lowest set bit of their group, so each multiset of
+// remaining cards has exactly one encoding in the transposition table.
+// Chance nodes are cut once even a perfect finish could not beat the best
+// card found so far (Star1-style pruning); stored values are always exact.
+class ExpectimaxSolver {
+private:
+    vector<int> ours, theirs;               // Hands at deal time, ascending
+    unordered_map<uint64_t, double> table;  // (ourMask, theirMask) -> value
+    long long nodes;
+
+    static int payoff(int a, int b) {
+        if (a > b) return 2;
+        if (a < b) return -2;
+        return 0;
+    }
+
+    // Mask with the highest `count` bits of every power group set
+    static uint32_t maskFor(const vector<int> &sorted, vector<int> current) {
+        sort(current.begin(), current.end());
+        uint32_t mask = 0;
+        int j = (int)current.size() - 1;
+        for (int i = (int)sorted.size() - 1; i >= 0 && j >= 0; i--) {
+            if (sorted[i] == current[j]) {
+                mask |= 1u << i;
+                j--;
+            }
+        }
+        return mask;
+    }
+
+    // Value of a state and the index of our best card in it
+    double search(uint32_t ourMask, uint32_t theirMask, int *bestIndex) {
+        if (ourMask == 0 || theirMask == 0) return 0;
+
+        uint64_t key = ourMask | ((uint64_t)theirMask << 32);
+        if (!bestIndex) {
+            unordered_map<uint64_t, double>::iterator it = table.find(key);
+            if (it != table.end()) return it->second;
+        }
+        nodes++;
+
+        int remaining = __builtin_popcount(theirMask);
+        double best = -1e18;
+        int bestI = -1;
+
+        for (int i = 0; i < (int)ours.size(); i++) {
+            if (!(ourMask & (1u << i))) continue;
+            if (i > 0 && (ourMask & (1u << (i - 1))) && ours[i - 1] == ours[i]) continue;
+            uint32_t ourNext = ourMask & ~(1u << i);
+
+            // Chance node: sum over their cards grouped by power
+            double sum = 0;
+            int seen = 0;
+            bool cut = false;
+            for (int j = 0; j < (int)theirs.size(); j++) {
+                if (!(theirMask & (1u << j))) continue;
+                if (j > 0 && (theirMask & (1u << (j - 1))) && theirs[j - 1] == theirs[j]) continue;
+
+                int group = 0;
+                for (int k = j; k < (int)theirs.size() && theirs[k] == theirs[j]; k++)
+                    if (theirMask & (1u << k)) group++;
+
+                double v = payoff(ours[i], theirs[j]) + search(ourNext, theirMask & ~(1u << j), 0);
+                sum += group * v;
+                seen += group;
+
+                // Even winning every remaining round would not beat `best`
+                double bound = (sum + (double)(remaining - seen) * 2 * remaining) / remaining;
+                if (bound <= best) {
+                    cut = true;
+                    break;
+                }
+            }
+
+            if (!cut && sum / remaining > best) {
+                best = sum / remaining;
+                bestI = i;
+            }
+        }
+
+        table[key] = best;
+        if (bestIndex) *bestIndex = bestI;
+        return best;
+    }
+
+public:
+    static const int MAX_HAND = 10;
+
+    ExpectimaxSolver() { nodes = 0; }
+
+    static bool fits(int handSize) { return handSize <= MAX_HAND; }
+
+    // Start a new deal; the table is kept for the whole game
+    void reset(vector<int> ourPowers, vector<int> theirPowers) {
+        ours = ourPowers;
+        theirs = theirPowers;
+        sort(ours.begin(), ours.end());
+        sort(theirs.begin(), theirs.end());
+        table.clear();
+        nodes = 0;
+    }
+
+    // Expected final score difference for us under optimal play
+    double value(const vector<int> &ourPowers, const vector<int> &theirPowers) {
+        return search(maskFor(ours, ourPowers), maskFor(theirs, theirPowers), 0);
+    }
+
+    // Power of the card that maximizes the expected score difference
+    int choose(const vector<int> &ourPowers, const vector<int> &theirPowers) {
+        int bestIndex = -1;
+        search(maskFor(ours, ourPowers), maskFor(theirs, theirPowers), &bestIndex);
+        return ours[bestIndex];
+    }
+
+    long long nodesSearched() const { return nodes; }
+};
+
+// ===============================
+// DECK BUILDING
+// ===============================
+
+// Picks exactly `slots` cards with the highest total power that stays within
+// `budget`. Small problems are solved exactly by a subset-sum DP over bitsets:
+// one bitset of reachable power totals per card count, with cards of equal
+// power handled as one bounded group (binary split into bundles). Big pools
+// use a sorted sliding window followed by upward swaps, O(n log n), which on
+// dealt pools ends at or within a few points of the budget.
+class DeckBuilder {
+public:
+    struct Result {
+        vector<int> chosen;  // Indices into the powers given
+        long long total;
+        bool exact;          // Known to be the best possible total
+        bool fits;           // False if even the cheapest cards break the budget
+    };
+
+    static const long long MAX_DP_WORDS = 1LL << 21;   // 16 MB of DP tables
+
+    static Result build(const vector<int> &powers, int slots, long long budget) {
+        int n = (int)powers.size();
+        slots = max(0, min(slots, n));
+        vector<int> order(n);
+        for (int i = 0; i < n; i++) order[i] = i;
+        sort(order.begin(), order.end(), [&](int a, int b) { return powers[a] < powers[b]; });
+
+        long long low = 0, high = 0;
+        for (int i = 0; i < slots; i++) {
+            low += powers[order[i]];
+            high += powers[order[n - 1 - i]];
+        }
+
+        Result r;
+        r.exact = true;
+        r.fits = low <= budget;
+        if (!r.fits || high <= budget) {
+            // Nothing to decide: the cheapest cards, or the strongest ones
+            for (int i = 0; i < slots; i++) r.chosen.push_back(r.fits ? order[n - 1 - i] : order[i]);
+            r.total = r.fits ? high : low;
+            return r;
+        }
+
+        // Equal powers form one group: (power, first position in order, count)
+        vector<int> groupStart;
+        for (int i = 0; i < n; i++)
+            if (i == 0 || powers[order[i]] != powers[order[i - 1]]) groupStart.push_back(i);
+
+        long long words = budget / 64 + 1;
+        if ((long long)(groupStart.size() + 1) * (slots + 1) * words <= MAX_DP_WORDS)
+            return exactBuild(powers, order, groupStart, slots, budget);
+        return greedyBuild(powers, order, slots, budget);
+    }
+
+private:
+    // dst |= src << shift, keeping bits 0..limit
+    static void shiftOr(uint64_t *dst, const uint64_t *src, long long shift, long long words, long long limit) {
+        long long ws = shift / 64;
+        int bs = (int)(shift % 64);
+        for (long long i = words - 1; i >= ws; i--) {
+            uint64_t v = src[i - ws] << bs;
+            if (bs && i - ws - 1 >= 0) v |= src[i - ws - 1] >> (64 - bs);
+            dst[i] |= v;
+        }
+        dst[words - 1] &= (2ULL << (limit % 64)) - 1;
+    }
+
+    static bool test(const uint64_t *row, long long bit) {
+        return bit >= 0 && ((row[bit / 64] >> (bit % 64)) & 1);
+    }
+
+    static Result exactBuild(const vector<int> &powers, const vector<int> &order,
+                             const vector<int> &groupStart, int slots, long long budget) {
+        int n = (int)order.size(), groups = (int)groupStart.size();
+        long long words = budget / 64 + 1, layer = (long long)(slots + 1) * words;
+
+        // Layer g: reachable totals per card count using the first g groups
+        vector<uint64_t> reach((groups + 1) * layer, 0);
+        reach[0] = 1;
+        int seen = 0;
+        for (int g = 0; g < groups; g++) {
+            int power = powers[order[groupStart[g]]];
+            int count = (g + 1 < groups ? groupStart[g + 1] : n) - groupStart[g];
+            uint64_t *cur = &reach[(g + 1) * layer];
+            copy(&reach[g * layer], &reach[g * layer] + layer, cur);
+
+            for (int bundle = 1, left = count; left > 0; bundle *= 2) {
+                int take = min(bundle, left);
+                left -= take;
+                for (int c = min(slots, seen + count); c >= take; c--)
+                    shiftOr(cur + c * words, cur + (c - take) * words, (long long)take * power, words, budget);
+            }
+            seen += count;
+        }
+
+        // Highest total reachable with exactly `slots` cards
+        const uint64_t *last = &reach[groups * layer + slots * words];
+        long long best = budget;
+        while (!test(last, best)) best--;
+
+        // Walk back through the layers to see how many of each group were used
+        Result r;
+        r.total = best;
+        r.exact = true;
+        r.fits = true;
+        int c = slots;
+        long long sum = best;
+        for (int g = groups - 1; g >= 0; g--) {
+            int power = powers[order[groupStart[g]]];
+            const uint64_t *prev = &reach[g * layer];
+            int k = 0;
+            while (!test(prev + (c - k) * words, sum - (long long)k * power)) k++;
+            for (int i = 0; i < k; i++) r.chosen.push_back(order[groupStart[g] + i]);
+            c -= k;
+            sum -= (long long)k * power;
+        }
+        return r;
+    }
+
+    static Result greedyBuild(const vector<int> &powers, const vector<int> &order, int slots, long long budget) {
+        int n = (int)order.size();
+        vector<long long> prefix(n + 1, 0);
+        for (int i = 0; i < n; i++) prefix[i + 1] = prefix[i] + powers[order[i]];
+
+        // Window sums grow with the start, so the last fitting one is found by halving
+        int lo = 0, hi = n - slots;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (prefix[mid + slots] - prefix[mid] <= budget) lo = mid;
+            else hi = mid - 1;
+        }
+        long long slack = budget - (prefix[lo + slots] - prefix[lo]);
+
+        // Swap chosen cards, strongest first, for the strongest unused card the slack allows
+        vector<int> pos(order.begin() + lo, order.begin() + lo + slots);
+        multiset<pair<int, int> > unused;
+        for (int i = lo + slots; i < n; i++) unused.insert(make_pair(powers[order[i]], order[i]));
+        for (int i = slots - 1; i >= 0 && slack > 0 && !unused.empty(); i--) {
+            int mine = powers[pos[i]];
+            multiset<pair<int, int> >::iterator it =
+                unused.upper_bound(make_pair((int)min<long long>(mine + slack, INT_MAX), INT_MAX));
+            if (it == unused.begin()) continue;
+            --it;
+            if (it->first <= mine) continue;
+            slack -= it->first - mine;
+            unused.insert(make_pair(mine, pos[i]));
+            pos[i] = it->second;
+            unused.erase(it);
+        }
+
+        Result r;
+        r.chosen = pos;
+        r.total = budget - slack;
+        r.exact = slack == 0;
+        r.fits = true;
+        return r;
+    }
+};
+
+// ===============================
+// DRAFT
+// ===============================
+
+// A shared pool that drafters pick from in turn. Each drafting style ranks the
+// pool with its own max-heap, built on first use in O(n). A taken card is only
+// flagged, not removed from the other heaps; it is popped when it reaches the
+// top (lazy deletion). Every card leaves each heap at most once, so a pick is
+// O(log n) amortized, and any number of drafters share the heap of their style.
+class DraftPool {
+public:
+    enum Style { STRONGEST, RAREST };   // Highest power / highest rarity, then power
+
+private:
+    const vector<Card> &cards;
+    vector<char> taken;
+    int remaining;
+    vector<uint64_t> heaps[2];          // rank << 32 | card index, per style
+    bool built[2];
+
+    int rankOf(int i, Style style) const {
+        int power = cards[i].getPower();
+        if (style == STRONGEST) return power;
+        return rarityTier(cards[i].getRarity()) * 4096 + power;
+    }
+
+public:
+    DraftPool(const vector<Card> &pool) : cards(pool), taken(pool.size(), 0) {
+        remaining = (int)pool.size();
+        built[0] = built[1] = false;
+    }
+
+    int left() const { return remaining; }
+    bool isTaken(int i) const { return taken[i] != 0; }
+
+    void take(int i) {
+        if (taken[i]) return;
+        taken[i] = 1;
+        remaining--;
+    }
+
+    // Best card left for a style, or -1 when the pool is empty
+    int best(Style style) {
+        vector<uint64_t> &heap = heaps[style];
+        if (!built[style]) {
+            heap.reserve(cards.size());
+            for (int i = 0; i < (int)cards.size(); i++)
+                if (!taken[i]) heap.push_back((uint64_t)rankOf(i, style) << 32 | (uint32_t)i);
+            make_heap(heap.begin(), heap.end());
+            built[style] = true;
+        }
+        while (!heap.empty() && taken[(uint32_t)heap.front()]) {
+            pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+        }
+        return heap.empty() ? -1 : (int)(uint32_t)heap.front();
+    }
+};
+
+// ===============================
+// FAIR DEAL
+// ===============================
+
+// Deals the first `count` cards of a pool into two decks of equal size with
+// the same number of each rarity and nearly the same total power, in
+// O(n log n). Cards are sorted by rarity, then power, and paired with their
+// neighbour; one card of each pair goes to each deck, so only the direction
+// of every pair's power difference is left to choose. That is settled by
+// Karmarkar-Karp differencing: the two largest differences are replaced by
+// their difference, which puts them in opposite decks. A rarity with an odd
+// count leaves out its strongest card; those (at most four) are paired last,
+// so each rarity's counts differ by at most one.
+// Returns the power difference between the decks.
+long long fairSplit(const vector<Card> &pool, int count, vector<Card> &a, vector<Card> &b, mt19937 &rng) {
+    int n = min(count, (int)pool.size());
+    n -= n % 2;
+
+    // Powers stay within 1..1000, so rarity and power sort by counting
+    const int POWERS = 1001, LEVELS = 4 * POWERS;
+    vector<short> level(n);
+    vector<int> start(LEVELS + 1, 0);
+    for (int i = 0; i < n; i++) {
+        level[i] = (short)(rarityTier(pool[i].getRarity()) * POWERS + min(max(pool[i].getPower(), 0), POWERS - 1));
+        start[level[i] + 1]++;
+    }
+    for (int l = 0; l < LEVELS; l++) start[l + 1] += start[l];
+
+    // Neighbours of one rarity pair up; an odd card out joins the leftovers
+    vector<int> sorted(n), order, leftovers;
+    vector<int> next(start.begin(), start.end() - 1);
+    for (int i = 0; i < n; i++) sorted[next[level[i]]++] = i;
+    order.reserve(n);
+    for (int tier = 0; tier < 4; tier++) {
+        int from = start[tier * POWERS], to = start[(tier + 1) * POWERS];
+        if ((to - from) % 2) leftovers.push_back(sorted[--to]);
+        order.insert(order.end(), sorted.begin() + from, sorted.begin() + to);
+    }
+    order.insert(order.end(), leftovers.begin(), leftovers.end());
+    vector<int>().swap(sorted);
+    vector<short>().swap(level);
+
+    // Pair p is (weak[p], strong[p]); equal pairs can go either way
+    int pairs = n / 2;
+    vector<int> weak(pairs), strong(pairs);
+    vector<uint64_t> heap;   // difference << 32 | pair
+    for (int p = 0; p < pairs; p++) {
+        weak[p] = order[2 * p];
+        strong[p] = order[2 * p + 1];
+        int diff = pool[strong[p]].getPower() - pool[weak[p]].getPower();
+        if (diff < 0) {
+            swap(weak[p], strong[p]);
+            diff = -diff;
+        }
+        if (diff > 0) heap.push_back((uint64_t)diff << 32 | (uint32_t)p);
+    }
+    vector<int>().swap(order);
+    make_heap(heap.begin(), heap.end());
+
+    // Differencing; `under` records which pair was set against which
+    vector<int> under(pairs, -1), merged;
+    long long gap = 0;
+    while (heap.size() > 1) {
+        pop_heap(heap.begin(), heap.end());
+        uint64_t x = heap.back();
+        heap.pop_back();
+        pop_heap(heap.begin(), heap.end());
+        uint64_t y = heap.back();
+        heap.pop_back();
+
+        int px = (int)(uint32_t)x, py = (int)(uint32_t)y;
+        under[py] = px;
+        merged.push_back(py);
+        uint64_t rest = (x >> 32) - (y >> 32);
+        if (rest > 0) {
+            heap.push_back(rest << 32 | (uint32_t)px);
+            push_heap(heap.begin(), heap.end());
+        }
+    }
+    if (!heap.empty()) gap = (long long)(heap.front() >> 32);
+
+    // A pair merged later decides first, so undo the merges newest first.
+    // side 0 sends the stronger card to deck a.
+    vector<char> side(pairs, 0);
+    for (int k = (int)merged.size() - 1; k >= 0; k--)
+        side[merged[k]] = !side[under[merged[k]]];
+
+    // Give every card a random slot in its deck, then copy the pool in order
+    // (reading it sequentially is much faster than reading it shuffled)
+    vector<int> slotA(pairs), slotB(pairs), slot(n, -1);
+    for (int p = 0; p < pairs; p++) slotA[p] = slotB[p] = p;
+    shuffle(slotA.begin(), slotA.end(), rng);
+    shuffle(slotB.begin(), slotB.end(), rng);
+    for (int p = 0; p < pairs; p++) {
+        slot[side[p] ? weak[p] : strong[p]] = slotA[p];
+        slot[side[p] ? strong[p] : weak[p]] = pairs + slotB[p];
+    }
+
+    a.assign(pairs, Card());
+    b.assign(pairs, Card());
+    for (int i = 0; i < n; i++) {
+        if (slot[i] < pairs) a[slot[i]] = pool[i];
+        else b[slot[i] - pairs] = pool[i];
+    }
+    return gap;
+}
+
+// ===============================
+// MULTIPLAYER TABLE
+// ===============================
+
+// N-player engine: every active player draws one card per round and the
+// highest power takes all of them. Players whose decks run out drop off
+// the table; the game ends when fewer than two players hold cards.
+class Table {
+public:
+    struct RoundResult {
+        int winner;          // Player index, or -1 when the top power is tied
+        int topPower;
+        vector<int> tied;    // Players sharing the top power
+        int cardsPlayed;
+    };
+
+private:
+    vector<Player> players;
+    vector<int> active;      // Indices of players still holding cards
+    vector<int> fronts;      // Top card power of each active player, contiguous
+    vector<Card> played;     // Cards on the table this round
+    int roundNumber;
+
+public:
+    static const int MAX_CARDS = 2000000;   // All players' cards together
+
+    Table() { roundNumber = 1; }
+
+    void setPlayers(const vector<string> &names) {
+        players.clear();
+        for (size_t i = 0; i < names.size(); i++) players.push_back(Player(names[i]));
+    }
+
+    int playerCount() const { return (int)players.size(); }
+    int activeCount() const { return (int)active.size(); }
+    int getRoundNumber() const { return roundNumber; }
+    const Player &getPlayer(int i) const { return players[i]; }
+
+    // Cards of the last round, in seat order of the players who played
+    const vector<Card> &lastPlayed() const { return played; }
+    bool isOver() const { return active.size() < 2; }
+
+    // Deal the pool: 1 = round robin, 2 = consecutive blocks, 3 = random equal,
+    // 5 = draft (players pick in seat order, alternating the two draft styles),
+    // 6 = fair split (two players only; bigger tables get round robin).
+    // The numbers match the two-player dealers, so match history agrees.
+    // Cards left over after an equal split are not dealt.
+    void deal(const vector<Card> &pool, int distMode, mt19937 &rng) {
+        int n = (int)players.size();
+        for (int i = 0; i < n; i++) players[i] = Player(players[i].getName());
+
+        int per = (int)pool.size() / n;
+        vector<vector<Card> > decks(n);
+        if (distMode == 6 && n == 2) {
+            fairSplit(pool, per * 2, decks[0], decks[1], rng);
+        } else if (distMode == 1 || distMode == 6) {
+            for (int i = 0; i < per * n; i++)
+                decks[i % n].push_back(pool[i]);
+        } else if (distMode == 2) {
+            for (int i = 0; i < per * n; i++)
+                decks[i / per].push_back(pool[i]);
+        } else if (distMode == 5) {
+            DraftPool draft(pool);
+            for (int i = 0; i < per * n; i++) {
+                int pick = draft.best(i % n % 2 == 0 ? DraftPool::STRONGEST : DraftPool::RAREST);
+                draft.take(pick);
+                decks[i % n].push_back(pool[pick]);
+            }
+            for (int i = 0; i < n; i++) shuffle(decks[i].begin(), decks[i].end(), rng);
+        } else {
+            vector<int> owner(per * n);
+            for (int i = 0; i < per * n; i++) owner[i] = i % n;
+            shuffle(owner.begin(), owner.end(), rng);
+            for (int i = 0; i < per * n; i++)
+                decks[owner[i]].push_back(pool[i]);
+        }
+        for (int i = 0; i < n; i++) players[i].setDeck(decks[i]);
+
+        active.clear();
+        for (int i = 0; i < n; i++)
+            if (players[i].hasCards()) active.push_back(i);
+        roundNumber = 1;
+    }
+
+    RoundResult playRound() {
+        int n = (int)active.size();
+
+        // Gather top powers into one array so the max is a plain reduction
+        fronts.resize(n);
+        for (int k = 0; k < n; k++) fronts[k] = players[active[k]].peekPower();
+
+        int top = fronts[0];
+        for (int k = 1; k < n; k++) top = max(top, fronts[k]);
+
+        // Single pass: draw every card and collect the tie group
+        RoundResult r;
+        r.topPower = top;
+        r.cardsPlayed = n;
+        played.clear();
+        for (int k = 0; k < n; k++) {
+            played.push_back(players[active[k]].drawCard());
+            if (fronts[k] == top) r.tied.push_back(active[k]);
+        }
+
+        if (r.tied.size() == 1) {
+            r.winner = r.tied[0];
+            players[r.winner].addWinCards(played);
+        } else {
+            // Tied players keep their own card and share the rest in turn
+            r.winner = -1;
+            int next = 0;
+            for (int k = 0; k < n; k++) {
+                if (fronts[k] == top) {
+                    players[active[k]].keepOwnCard(played[k]);
+                } else {
+                    players[r.tied[next]].keepOwnCard(played[k]);
+                    next = (next + 1) % (int)r.tied.size();
+                }
+            }
+        }
+
+        // Drop players whose decks ran out
+        int kept = 0;
+        for (int k = 0; k < n; k++)
+            if (players[active[k]].hasCards()) active[kept++] = active[k];
+        active.resize(kept);
+
+        roundNumber++;
+        return r;
+    }
+
+    // Player indices ordered by score, best first
+    vector<int> standings() const {
+        vector<int> order(players.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+        stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            return players[a].getScore() > players[b].getScore();
+        });
+        return order;
+    }
+};
+
+// ===============================
+// SAVE FILES
+// ===============================
+
+// Little-endian byte buffer for save files
+class ByteWriter {
+private:
+    string buf;
+
+public:
+    void u8(int v) { buf += (char)(unsigned char)v; }
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; i++) buf += (char)(unsigned char)(v >> (8 * i));
+    }
+    void u64(uint64_t v) {
+        for (int i = 0; i < 8; i++) buf += (char)(unsigned char)(v >> (8 * i));
+    }
+    void str(const string &s) {
+        u32((uint32_t)s.size());
+        buf += s;
+    }
+    void card(const Card &c) {
+        str(c.getName());
+        u32((uint32_t)c.getPower());
+        str(c.getRarity());
+    }
+    const string &data() const { return buf; }
+};
+
+// Reads what ByteWriter wrote; any overrun marks the reader failed
+class ByteReader {
+private:
+    const string &buf;
+    size_t pos;
+    bool failed;
+
+    bool need(size_t n) {
+        if (failed || pos + n > buf.size()) failed = true;
+        return !failed;
+    }
+
+public:
+    ByteReader(const string &data) : buf(data) {
+        pos = 0;
+        failed = false;
+    }
+
+    bool ok() const { return !failed; }
+    size_t offset() const { return pos; }
+
+    int u8() {
+        if (!need(1)) return 0;
+        return (unsigned char)buf[pos++];
+    }
+    uint32_t u32() {
+        if (!need(4)) return 0;
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) v |= (uint32_t)(unsigned char)buf[pos++] << (8 * i);
+        return v;
+    }
+    uint64_t u64() {
+        if (!need(8)) return 0;
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++) v |= (uint64_t)(unsigned char)buf[pos++] << (8 * i);
+        return v;
+    }
+    string str() {
+        uint32_t n = u32();
+        if (!need(n)) return "";
+        string s = buf.substr(pos, n);
+        pos += n;
+        return s;
+    }
+    Card card() {
+        string name = str();
+        int power = (int)u32();
+        string rarity = str();
+        if (power < 0 || power > MAX_POWER) failed = true;
+        return Card(name, power, rarity);
+    }
+};
+
+// Write a whole file so that a crash leaves either the old or the new one
+bool writeFileAtomically(const string &path, const string &data) {
+    string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size() && fflush(f) == 0;
+#ifdef __linux__
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    fclose(f);
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool readWholeFile(const string &path, string &data) {
+    ifstream in(path.c_str(), ios::binary);
+    if (!in) return false;
+    stringstream ss;
+    ss << in.rdbuf();
+    data = ss.str();
+    return true;
+}
+
+// FNV-1a, for save checksums and the lockstep state hash
+uint64_t hashMix(uint64_t h, const string &text) {
+    for (size_t i = 0; i < text.size(); i++) {
+        h ^= (unsigned char)text[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t hashMix(uint64_t h, long long value) {
+    for (int i = 0; i < 8; i++) {
+        h ^= (unsigned char)(value >> (8 * i));
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// ===============================
+// RATINGS
+// ===============================
+
+struct Rating {
+    double elo;
+    double glicko;       // Glicko-1 rating
+    double rd;           // Glicko-1 rating deviation
+    int games;
+
+    Rating() {
+        elo = 1500;
+        glicko = 1500;
+        rd = 350;
+        games = 0;
+    }
+};
+
+// Players ordered by rating in a treap whose nodes know their subtree size,
+// so rank, k-th place and top-K are O(log n) (+K) without sorting anything.
+// Readers share the lock; rating updates take it exclusively.
+class Leaderboard {
+private:
+    struct Node {
+        string name;
+        double rating;
+        unsigned prio;
+        int left, right, size;
+    };
+
+    vector<Node> nodes;                  // Node pool; freed slots are reused
+    vector<int> freeSlots;
+    int root;
+    unordered_map<string, double> current; // Rating each player is filed under
+    mt19937 rng;
+    mutable shared_mutex m;
+
+    // Higher rating first, then by name
+    static bool before(double ra, const string &na, double rb, const string &nb) {
+        if (ra != rb) return ra > rb;
+        return na < nb;
+    }
+
+    int size(int t) const { return t < 0 ? 0 : nodes[t].size; }
+
+    void pull(int t) { nodes[t].size = 1 + size(nodes[t].left) + size(nodes[t].right); }
+
+    // Split into keys before (rating, name) and the rest
+    void split(int t, double rating, const string &name, int &l, int &r) {
+        if (t < 0) {
+            l = r = -1;
+            return;
+        }
+        if (before(nodes[t].rating, nodes[t].name, rating, name)) {
+            split(nodes[t].right, rating, name, nodes[t].right, r);
+            l = t;
+        } else {
+            split(nodes[t].left, rating, name, l, nodes[t].left);
+            r = t;
+        }
+        pull(t);
+    }
+
+    int merge(int l, int r) {
+        if (l < 0) return r;
+        if (r < 0) return l;
+        if (nodes[l].prio > nodes[r].prio) {
+            nodes[l].right = merge(nodes[l].right, r);
+            pull(l);
+            return l;
+        }
+        nodes[r].left = merge(l, nodes[r].left);
+        pull(r);
+        return r;
+    }
+
+    int erase(int t, double rating, const string &name) {
+        if (t < 0) return t;
+        if (nodes[t].rating == rating && nodes[t].name == name) {
+            int joined = merge(nodes[t].left, nodes[t].right);
+            freeSlots.push_back(t);
+            return joined;
+        }
+        if (before(rating, name, nodes[t].rating, nodes[t].name))
+            nodes[t].left = erase(nodes[t].left, rating, name);
+        else
+            nodes[t].right = erase(nodes[t].right, rating, name);
+        pull(t);
+        return t;
+    }
+
+    // Callers hold m (shared or unique)
+    int rankLocked(const string &name) const {
+        unordered_map<string, double>::const_iterator it = current.find(name);
+        if (it == current.end()) return 0;
+
+        int rank = 0, t = root;
+        while (t >= 0) {
+            if (nodes[t].rating == it->second && nodes[t].name == name)
+                return rank + size(nodes[t].left) + 1;
+            if (before(it->second, name, nodes[t].rating, nodes[t].name)) {
+                t = nodes[t].left;
+            } else {
+                rank += size(nodes[t].left) + 1;
+                t = nodes[t].right;
+            }
+        }
+        return 0;
+    }
+
+    // One descent to place `first`, then an in-order walk: O(log n + K)
+    vector<pair<string, double> > rangeLocked(int first, int last) const {
+        vector<pair<string, double> > out;
+        first = max(first, 1);
+        last = min(last, size(root));
+        if (first > last) return out;
+
+        // Stack the target and every ancestor still to come after it
+        vector<int> path;
+        int t = root, k = first - 1;
+        while (t >= 0) {
+            int ls = size(nodes[t].left);
+            if (k < ls) {
+                path.push_back(t);
+                t = nodes[t].left;
+            } else if (k == ls) {
+                path.push_back(t);
+                break;
+            } else {
+                k -= ls + 1;
+                t = nodes[t].right;
+            }
+        }
+
+        while ((int)out.size() <= last - first && !path.empty()) {
+            int u = path.back();
+            path.pop_back();
+            out.push_back(make_pair(nodes[u].name, nodes[u].rating));
+            for (int c = nodes[u].right; c >= 0; c = nodes[c].left) path.push_back(c);
+        }
+        return out;
+    }
+
+public:
+    Leaderboard() : rng(12345) { root = -1; }
+
+    // Insert a player or move them to a new rating
+    void update(const string &name, double rating) {
+        unique_lock<shared_mutex> lock(m);
+        unordered_map<string, double>::iterator it = current.find(name);
+        if (it != current.end()) {
+            root = erase(root, it->second, name);
+            it->second = rating;
+        } else {
+            current[name] = rating;
+        }
+
+        int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = (int)nodes.size();
+            nodes.push_back(Node());
+        }
+        Node &n = nodes[slot];
+        n.name = name;
+        n.rating = rating;
+        n.prio = (unsigned)rng();
+        n.left = n.right = -1;
+        n.size = 1;
+
+        int l, r;
+        split(root, rating, name, l, r);
+        root = merge(merge(l, slot), r);
+    }
+
+    int playerCount() const {
+        shared_lock<shared_mutex> lock(m);
+        return size(root);
+    }
+
+    // Places first..last (1-based, inclusive) as (name, rating)
+    vector<pair<string, double> > range(int first, int last) const {
+        shared_lock<shared_mutex> lock(m);
+        return rangeLocked(first, last);
+    }
+
+    vector<pair<string, double> > top(int k) const { return range(1, k); }
+
+    // Players within `radius` places of `name`, and the rank they were read
+    // around (0 for an unknown player). One lock covers both, so an update
+    // cannot move the player in between.
+    vector<pair<string, double> > around(const string &name, int radius, int &rank) const {
+        shared_lock<shared_mutex> lock(m);
+        rank = rankLocked(name);
+        if (rank == 0) return vector<pair<string, double> >();
+        return rangeLocked(rank - radius, rank + radius);
+    }
+};
+
+// Elo and Glicko-1 ratings keyed by player name.
+// Every update is appended to a log file as one "name<TAB>elo<TAB>glicko<TAB>rd<TAB>games"
+// line and the latest line per name wins when the log is replayed at start.
+// Lookups go through an in-memory hash index. Appends are buffered and
+// written in large batches, never synced per result; the log is rewritten
+// (write a temp file, then rename) once it holds mostly stale lines.
+class RatingStore {
+private:
+    string path;
+    unordered_map<string, Rating> index;
+    string buffer;            // Lines not yet written to the log
+    long long logLines;       // Lines in the log, live or stale
+    bool logBehind;           // A write failed; rewrite the log from the index
+    Leaderboard board;        // Players ranked by Glicko rating
+    mutable mutex m;
+
+    static const size_t FLUSH_BYTES = 1 << 16;
+
+    static double g(double rd) {
+        const double q = log(10.0) / 400, pi = acos(-1.0);
+        return 1 / sqrt(1 + 3 * q * q * rd * rd / (pi * pi));
+    }
+
+    // One-game Glicko-1 rating period for `self` against `other`
+    static void glickoUpdate(Rating &self, const Rating &other, double score) {
+        const double q = log(10.0) / 400;
+        double gj = g(other.rd);
+        double e = 1 / (1 + pow(10.0, -gj * (self.glicko - other.glicko) / 400));
+        double d2 = 1 / (q * q * gj * gj * e * (1 - e));
+        double denom = 1 / (self.rd * self.rd) + 1 / d2;
+        self.glicko += q / denom * gj * (score - e);
+        self.rd = max(30.0, sqrt(1 / denom));
+    }
+
+    void appendLocked(const string &name, const Rating &r) {
+        char line[128];
+        snprintf(line, sizeof(line), "\t%.2f\t%.2f\t%.2f\t%d\n", r.elo, r.glicko, r.rd, r.games);
+        buffer += name;
+        buffer += line;
+        logLines++;
+        if (buffer.size() >= FLUSH_BYTES) flushLocked();
+    }
+
+    // The index holds every rating, so a failed append is not kept around:
+    // the buffer is dropped and the whole log is rewritten once writes work
+    void flushLocked() {
+        if (logBehind) {
+            buffer.clear();
+            compactLocked();
+            return;
+        }
+        if (buffer.empty()) return;
+        FILE *f = fopen(path.c_str(), "ab");
+        bool ok = f && fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+        if (f && fclose(f) != 0) ok = false;
+        buffer.clear();
+        if (!ok) {
+            logBehind = true;
+            return;
+        }
+
+        if (logLines > 10000 && logLines > 2 * (long long)index.size()) compactLocked();
+    }
+
+    // Rewrite the log with one line per player; the old log stays unless
+    // the new one is completely on disk
+    bool compactLocked() {
+        string out;
+        for (unordered_map<string, Rating>::const_iterator it = index.begin(); it != index.end(); ++it) {
+            char line[128];
+            snprintf(line, sizeof(line), "\t%.2f\t%.2f\t%.2f\t%d\n",
+                     it->second.elo, it->second.glicko, it->second.rd, it->second.games);
+            out += it->first;
+            out += line;
+        }
+        if (!writeFileAtomically(path, out)) return false;
+        logLines = (long long)index.size();
+        logBehind = false;
+        return true;
+    }
+
+public:
+    RatingStore(const string &file = "ratings.log") {
+        path = file;
+        logLines = 0;
+        logBehind = false;
+
+        ifstream in(path.c_str());
+        string line;
+        while (getline(in, line)) {
+            stringstream ss(line);
+            string name;
+            Rating r;
+            if (!getline(ss, name, '\t')) continue;
+            if (!(ss >> r.elo >> r.glicko >> r.rd >> r.games)) continue;
+            index[name] = r;
+            logLines++;
+        }
+
+        for (unordered_map<string, Rating>::const_iterator it = index.begin(); it != index.end(); ++it)
+            board.update(it->first, it->second.glicko);
+    }
+
+    const Leaderboard &leaderboard() const { return board; }
+
+    ~RatingStore() { flush(); }
+
+    void flush() {
+        lock_guard<mutex> lock(m);
+        flushLocked();
+    }
+
+    Rating get(const string &name) const {
+        lock_guard<mutex> lock(m);
+        unordered_map<string, Rating>::const_iterator it = index.find(name);
+        return it == index.end() ? Rating() : it->second;
+    }
+
+    int playerCount() const {
+        lock_guard<mutex> lock(m);
+        return (int)index.size();
+    }
+
+    // scoreA is 1 for a win by a, 0.5 for a draw, 0 for a loss
+    void recordResult(const string &a, const string &b, double scoreA) {
+        lock_guard<mutex> lock(m);
+        Rating &ra = index[a];
+        Rating &rb = index[b];
+        Rating oldA = ra, oldB = rb;
+
+        double expectedA = 1 / (1 + pow(10.0, (oldB.elo - oldA.elo) / 400));
+        ra.elo += 32 * (scoreA - expectedA);
+        rb.elo -= 32 * (scoreA - expectedA);
+
+        glickoUpdate(ra, oldB, scoreA);
+        glickoUpdate(rb, oldA, 1 - scoreA);
+        ra.games++;
+        rb.games++;
+
+        appendLocked(a, ra);
+        appendLocked(b, rb);
+        board.update(a, ra.glicko);
+        board.update(b, rb.glicko);
+    }
+};
+
+// Strip tabs and newlines so a name fits on one rating log line
+string ratingKey(const string &name) {
+    string key = name;
+    for (size_t i = 0; i < key.size(); i++)
+        if (key[i] == '\t' || key[i] == '\n' || key[i] == '\r') key[i] = ' ';
+    return key;
+}
+
+// ===============================
+// MATCH HISTORY
+// ===============================
+
+struct MatchRecord {
+    long long time;          // Unix seconds
+    string playerA, playerB;
+    int scoreA, scoreB;
+    int totalCards;
+    int distMode;
+    int source;              // MatchHistory::Source
+};
+
+struct PlayerAggregate {
+    int games, wins, losses, draws;
+    long long cardsWon;
+
+    PlayerAggregate() {
+        games = wins = losses = draws = 0;
+        cardsWon = 0;
+    }
+};
+
+// Every finished match, kept in append-only segment files under a folder.
+// A record is framed as length + payload + checksum, so a torn write at the
+// end of the last segment is dropped when the folder is read back. The
+// active segment is sealed at SEGMENT_BYTES and a new one started; appends
+// are buffered and written in batches. In memory, records are indexed by
+// player, by time (sorted, for range scans) and by distribution mode, and
+// per-player totals are kept up to date, so no query scans the history.
+// compact() merges all segments into one, optionally dropping old records.
+class MatchHistory {
+public:
+    enum Source { CONSOLE = 0, TOURNAMENT = 1, MATCHMAKING = 2, SERVER = 3 };
+
+private:
+    static const size_t SEGMENT_BYTES = 4 << 20;
+    static const size_t FLUSH_BYTES = 1 << 16;
+
+    string folder;
+    vector<MatchRecord> records;
+    unordered_map<string, vector<int> > byPlayer;
+    multimap<long long, int> byTime;
+    vector<int> byDist[7];                 // Index 1..6
+    unordered_map<string, PlayerAggregate> totals;
+
+    int activeSegment;
+    size_t activeBytes;
+    string buffer;
+    bool diskBehind;         // An append failed; the segments miss records we hold
+    mutable mutex m;
+
+    string segmentPath(int n) const {
+        char name[32];
+        snprintf(name, sizeof(name), "seg-%06d.log", n);
+        return folder + "/" + name;
+    }
+
+    static string encode(const MatchRecord &r) {
+        ByteWriter w;
+        w.u64((uint64_t)r.time);
+        w.str(r.playerA);
+        w.str(r.playerB);
+        w.u32((uint32_t)r.scoreA);
+        w.u32((uint32_t)r.scoreB);
+        w.u32((uint32_t)r.totalCards);
+        w.u8(r.distMode);
+        w.u8(r.source);
+
+        ByteWriter frame;
+        frame.u32((uint32_t)w.data().size());
+        frame.u64(hashMix(14695981039346656037ULL, w.data()));
+        return frame.data() + w.data();
+    }
+
+    // Decode every complete record of one segment file; returns bytes used
+    static size_t decodeSegment(const string &data, vector<MatchRecord> &out) {
+        size_t pos = 0;
+        while (data.size() - pos >= 12) {
+            string head = data.substr(pos, 12);
+            ByteReader h(head);
+            uint32_t len = h.u32();
+            uint64_t check = h.u64();
+            if (data.size() - pos - 12 < len) break;
+
+            string payload = data.substr(pos + 12, len);
+            if (hashMix(14695981039346656037ULL, payload) != check) break;
+            ByteReader r(payload);
+            MatchRecord rec;
+            rec.time = (long long)r.u64();
+            rec.playerA = r.str();
+            rec.playerB = r.str();
+            rec.scoreA = (int)r.u32();
+            rec.scoreB = (int)r.u32();
+            rec.totalCards = (int)r.u32();
+            rec.distMode = r.u8();
+            rec.source = r.u8();
+            if (!r.ok()) break;
+            out.push_back(rec);
+            pos += 12 + len;
+        }
+        return pos;
+    }
+
+    static void addTo(PlayerAggregate &agg, int mine, int theirs) {
+        agg.games++;
+        agg.cardsWon += mine;
+        if (mine > theirs) agg.wins++;
+        else if (mine < theirs) agg.losses++;
+        else agg.draws++;
+    }
+
+    void indexLocked(const MatchRecord &r) {
+        int id = (int)records.size();
+        records.push_back(r);
+        byPlayer[r.playerA].push_back(id);
+        if (r.playerB != r.playerA) byPlayer[r.playerB].push_back(id);
+        byTime.insert(make_pair(r.time, id));
+        if (r.distMode >= 1 && r.distMode <= 6) byDist[r.distMode].push_back(id);
+        addTo(totals[r.playerA], r.scoreA, r.scoreB);
+        addTo(totals[r.playerB], r.scoreB, r.scoreA);
+    }
+
+    // Every record is also in memory, so a failed append is not kept
+    // around: the torn tail is cut off, the buffer is dropped and all
+    // segments are rewritten from memory once writes work
+    void flushLocked() {
+        if (diskBehind) {
+            buffer.clear();
+            compactLocked(0);
+            return;
+        }
+        if (buffer.empty()) return;
+        string path = segmentPath(activeSegment);
+        FILE *f = fopen(path.c_str(), "ab");
+        bool ok = f && fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+        if (f && fclose(f) != 0) ok = false;
+        size_t written = buffer.size();
+        buffer.clear();
+        if (!ok) {
+            error_code ec;
+            if (f) filesystem::resize_file(path, activeBytes, ec);
+            diskBehind = true;
+            return;
+        }
+        activeBytes += written;
+
+        if (activeBytes >= SEGMENT_BYTES) {
+            activeSegment++;
+            activeBytes = 0;
+        }
+    }
+
+    // Rewrite every segment as one from the records in memory, dropping
+    // those older than `keepAfter`. On failure the old segments stay and
+    // the next flush tries again.
+    bool compactLocked(long long keepAfter) {
+        vector<MatchRecord> kept;
+        for (multimap<long long, int>::const_iterator it = byTime.begin(); it != byTime.end(); ++it)
+            if (it->first >= keepAfter) kept.push_back(records[it->second]);
+
+        string data;
+        for (size_t i = 0; i < kept.size(); i++) data += encode(kept[i]);
+
+        // New segment goes in under a number above every old one, then the
+        // old ones are removed; a crash in between only leaves duplicates
+        // of records that are still in the old segments
+        vector<int> old = segmentNumbers();
+        int target = old.empty() ? 1 : old.back() + 1;
+        diskBehind = !writeFileAtomically(segmentPath(target), data);
+        if (diskBehind) return false;
+        for (size_t i = 0; i < old.size(); i++) remove(segmentPath(old[i]).c_str());
+
+        records.clear();
+        byPlayer.clear();
+        byTime.clear();
+        for (int d = 0; d < 7; d++) byDist[d].clear();
+        totals.clear();
+        for (size_t i = 0; i < kept.size(); i++) indexLocked(kept[i]);
+
+        activeSegment = target;
+        activeBytes = data.size();
+        if (activeBytes >= SEGMENT_BYTES) {
+            activeSegment++;
+            activeBytes = 0;
+        }
+        return true;
+    }
+
+    vector<int> segmentNumbers() const {
+        vector<int> numbers;
+        error_code ec;
+        for (filesystem::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+            string file = it->path().filename().string();
+            if (file.size() == 14 && file.compare(0, 4, "seg-") == 0 && file.compare(10, 4, ".log") == 0)
+                numbers.push_back(atoi(file.c_str() + 4));
+        }
+        sort(numbers.begin(), numbers.end());
+        return numbers;
+    }
+
+public:
+    MatchHistory(const string &dir = "history") {
+        folder = dir;
+        activeSegment = 1;
+        activeBytes = 0;
+        diskBehind = false;
+
+        error_code ec;
+        filesystem::create_directories(folder, ec);
+
+        vector<int> numbers = segmentNumbers();
+        bool torn = false;
+        for (size_t i = 0; i < numbers.size(); i++) {
+            string data;
+            if (!readWholeFile(segmentPath(numbers[i]), data)) continue;
+            vector<MatchRecord> decoded;
+            torn = decodeSegment(data, decoded) != data.size();
+            for (size_t k = 0; k < decoded.size(); k++) indexLocked(decoded[k]);
+            activeBytes = data.size();
+        }
+
+        // Keep appending to the newest segment, unless it is full or ends in
+        // a torn record (anything written after that could not be read back)
+        if (!numbers.empty()) {
+            activeSegment = numbers.back();
+            if (torn || activeBytes >= SEGMENT_BYTES) {
+                activeSegment++;
+                activeBytes = 0;
+            }
+        }
+    }
+
+    ~MatchHistory() { flush(); }
+
+    void flush() {
+        lock_guard<mutex> lock(m);
+        flushLocked();
+    }
+
+    void record(const string &a, const string &b, int scoreA, int scoreB,
+                int totalCards, int distMode, Source source) {
+        MatchRecord r;
+        r.time = (long long)time(0);
+        r.playerA = a;
+        r.playerB = b;
+        r.scoreA = scoreA;
+        r.scoreB = scoreB;
+        r.totalCards = totalCards;
+        r.distMode = distMode;
+        r.source = source;
+
+        lock_guard<mutex> lock(m);
+        indexLocked(r);
+        buffer += encode(r);
+        if (buffer.size() >= FLUSH_BYTES) flushLocked();
+    }
+
+    long long size() const {
+        lock_guard<mutex> lock(m);
+        return (long long)records.size();
+    }
+
+    PlayerAggregate totalsFor(const string &player) const {
+        lock_guard<mutex> lock(m);
+        unordered_map<string, PlayerAggregate>::const_iterator it = totals.find(player);
+        return it == totals.end() ? PlayerAggregate() : it->second;
+    }
+
+    // Most recent matches of a player, newest first
+    vector<MatchRecord> recentFor(const string &player, int limit) const {
+        lock_guard<mutex> lock(m);
+        vector<MatchRecord> out;
+        unordered_map<string, vector<int> >::const_iterator it = byPlayer.find(player);
+        if (it == byPlayer.end()) return out;
+        for (int i = (int)it->second.size() - 1; i >= 0 && (int)out.size() < limit; i--)
+            out.push_back(records[it->second[i]]);
+        return out;
+    }
+
+    // Matches with from <= time < to, oldest first; `count` gets the full total
+    vector<MatchRecord> between(long long from, long long to, int limit, long long &count) const {
+        lock_guard<mutex> lock(m);
+        vector<MatchRecord> out;
+        count = 0;
+        multimap<long long, int>::const_iterator it = byTime.lower_bound(from);
+        multimap<long long, int>::const_iterator end = byTime.lower_bound(to);
+        for (; it != end; ++it) {
+            if ((int)out.size() < limit) out.push_back(records[it->second]);
+            count++;
+        }
+        return out;
+    }
+
+    long long countForDistMode(int distMode) const {
+        lock_guard<mutex> lock(m);
+        return (distMode >= 1 && distMode <= 6) ? (long long)byDist[distMode].size() : 0;
+    }
+
+    // Rewrite all segments as one, dropping records older than `keepAfter`
+    // (0 keeps everything). Returns the number of records kept.
+    long long compact(long long keepAfter) {
+        lock_guard<mutex> lock(m);
+        buffer.clear();                 // The rewrite holds these records too
+        compactLocked(keepAfter);
+        return (long long)records.size();
+    }
+};
+
+// ===============================
+// TOURNAMENTS
+// ===============================
+
+struct MatchResult {
+    int scoreA, scoreB;
+    int winner;              // 0 = first player, 1 = second, -1 = draw
+};
+
+// Play a whole two-player match without any screen output
+MatchResult playHeadlessMatch(const string &nameA, const string &nameB,
+                              int totalCards, int distMode, unsigned seed) {
+    mt19937 rng(seed);
+    vector<string> names;
+    names.push_back(nameA);
+    names.push_back(nameB);
+
+    Table t;
+    t.setPlayers(names);
+    t.deal(makeCardPool(totalCards, rng), distMode, rng);
+    while (!t.isOver()) t.playRound();
+
+    MatchResult r;
+    r.scoreA = t.getPlayer(0).getScore();
+    r.scoreB = t.getPlayer(1).getScore();
+    r.winner = r.scoreA > r.scoreB ? 0 : (r.scoreB > r.scoreA ? 1 : -1);
+    return r;
+}
+
+// Tasks with dependencies, run on the pool as soon as all their inputs are
+// done. Tasks may add new tasks while running (Swiss pairings do).
+class TaskGraph {
+private:
+    struct Node {
+        function<void()> work;
+        vector<int> dependents;
+        int pending;
+        bool finished;
+    };
+
+    ThreadPool &pool;
+    mutex m;
+    condition_variable allDone;
+    vector<Node> nodes;
+    int unfinished;
+
+    void launch(int id) {
+        pool.submit([this, id] {
+            function<void()> work;
+            {
+                lock_guard<mutex> lock(m);
+                work = nodes[id].work;
+            }
+            work();
+            finish(id);
+        });
+    }
+
+    void finish(int id) {
+        vector<int> ready;
+        {
+            lock_guard<mutex> lock(m);
+            nodes[id].finished = true;
+            nodes[id].work = nullptr;
+            for (size_t i = 0; i < nodes[id].dependents.size(); i++) {
+                int d = nodes[id].dependents[i];
+                if (--nodes[d].pending == 0) ready.push_back(d);
+            }
+            unfinished--;
+            if (unfinished == 0) allDone.notify_all();
+        }
+        for (size_t i = 0; i < ready.size(); i++) launch(ready[i]);
+    }
+
+public:
+    TaskGraph(ThreadPool &p) : pool(p) { unfinished = 0; }
+
+    // Returns the task id to use in later dependency lists
+    int add(function<void()> work, const vector<int> &deps) {
+        int id;
+        bool ready;
+        {
+            lock_guard<mutex> lock(m);
+            id = (int)nodes.size();
+            Node node;
+            node.work = work;
+            node.pending = 0;
+            node.finished = false;
+            nodes.push_back(node);
+            for (size_t i = 0; i < deps.size(); i++) {
+                if (!nodes[deps[i]].finished) {
+                    nodes[deps[i]].dependents.push_back(id);
+                    nodes[id].pending++;
+                }
+            }
+            unfinished++;
+            ready = (nodes[id].pending == 0);
+        }
+        if (ready) launch(id);
+        return id;
+    }
+
+    // Block until every task, including ones added later, has finished
+    void wait() {
+        unique_lock<mutex> lock(m);
+        allDone.wait(lock, [this] { return unfinished == 0; });
+    }
+};
+
+// Single elimination, Swiss and round robin events between named players.
+// Every match is a headless game seeded from the event seed, so an event
+// replays exactly. Points are 2 for a win, 1 for a draw and 0 for a loss.
+class Tournament {
+public:
+    enum Format { SINGLE_ELIMINATION = 1, SWISS = 2, ROUND_ROBIN = 3 };
+
+private:
+    ThreadPool &pool;
+    RatingStore *ratings;       // Optional, updated after every match
+    MatchHistory *history;      // Optional, gets every match
+    vector<string> names;
+    int cardsPerMatch;
+    int distMode;
+    unsigned seed;
+
+    mutex m;                    // Guards everything below
+    vector<int> points;
+    vector<long long> cardScore;  // Tie-break: total cards won
+    vector<set<int> > opponents;  // Swiss: who has met whom
+    deque<int> bracketWinners;    // Single elimination: winner of each match
+    long long matchesPlayed;
+    int champion;
+
+    MatchResult play(int a, int b, unsigned matchSeed) {
+        MatchResult r = playHeadlessMatch(names[a], names[b], cardsPerMatch, distMode, matchSeed);
+        if (ratings)
+            ratings->recordResult(ratingKey(names[a]), ratingKey(names[b]),
+                                  r.winner == 0 ? 1.0 : (r.winner == 1 ? 0.0 : 0.5));
+        if (history)
+            history->record(names[a], names[b], r.scoreA, r.scoreB, cardsPerMatch, distMode,
+                            MatchHistory::TOURNAMENT);
+        lock_guard<mutex> lock(m);
+        points[a] += r.winner == 0 ? 2 : (r.winner == -1 ? 1 : 0);
+        points[b] += r.winner == 1 ? 2 : (r.winner == -1 ? 1 : 0);
+        cardScore[a] += r.scoreA;
+        cardScore[b] += r.scoreB;
+        matchesPlayed++;
+        return r;
+    }
+
+    // Standard bracket order so top seeds meet last and get the byes
+    static vector<int> bracketOrder(int size) {
+        vector<int> order(1, 0);
+        while ((int)order.size() < size) {
+            int n = (int)order.size() * 2;
+            vector<int> next;
+            for (size_t i = 0; i < order.size(); i++) {
+                next.push_back(order[i]);
+                next.push_back(n - 1 - order[i]);
+            }
+            order = next;
+        }
+        return order;
+    }
+
+    void runSingleElimination(TaskGraph &graph) {
+        int n = (int)names.size();
+        int size = 1;
+        while (size < n) size *= 2;
+
+        // A slot holds a player, a bye (-1), or the winner of a match task
+        struct Slot {
+            int player;
+            int task;
+            int *winner;
+        };
+        vector<int> order = bracketOrder(size);
+        vector<Slot> slots;
+        for (int i = 0; i < size; i++) {
+            Slot s;
+            s.player = order[i] < n ? order[i] : -1;
+            s.task = -1;
+            s.winner = 0;
+            slots.push_back(s);
+        }
+
+        // Winners live in a deque so pointers stay valid as it grows
+        bracketWinners.clear();
+        int matchNo = 0;
+        while (slots.size() > 1) {
+            vector<Slot> next;
+            for (size_t i = 0; i < slots.size(); i += 2) {
+                Slot a = slots[i], b = slots[i + 1];
+                bool aBye = a.task < 0 && a.player < 0;
+                bool bBye = b.task < 0 && b.player < 0;
+                if (aBye || bBye) {
+                    next.push_back(aBye ? b : a);
+                    continue;
+                }
+
+                bracketWinners.push_back(-1);
+                int *out = &bracketWinners.back();
+                unsigned matchSeed = seed + 7919u * (unsigned)(++matchNo);
+                vector<int> deps;
+                if (a.task >= 0) deps.push_back(a.task);
+                if (b.task >= 0) deps.push_back(b.task);
+
+                Slot s;
+                s.player = -1;
+                s.winner = out;
+                s.task = graph.add([this, a, b, out, matchSeed] {
+                    int pa = a.winner ? *a.winner : a.player;
+                    int pb = b.winner ? *b.winner : b.player;
+                    // Replay drawn matches; the better seed advances after 5 draws
+                    MatchResult r = play(pa, pb, matchSeed);
+                    for (int k = 1; r.winner == -1 && k <= 5; k++)
+                        r = play(pa, pb, matchSeed + k);
+                    *out = r.winner == 1 ? pb : (r.winner == 0 ? pa : min(pa, pb));
+                }, deps);
+                next.push_back(s);
+            }
+            slots = next;
+        }
+
+        graph.wait();
+        champion = slots[0].winner ? *slots[0].winner : slots[0].player;
+    }
+
+    void runRoundRobin(TaskGraph &graph) {
+        // One task per pair of rows (a, n-1-a) keeps the tasks coarse and even
+        int n = (int)names.size();
+        for (int a = 0; a <= (n - 1) / 2; a++) {
+            graph.add([this, a, n] {
+                int rows[2] = { a, n - 1 - a };
+                for (int k = 0; k < (rows[0] == rows[1] ? 1 : 2); k++) {
+                    int x = rows[k];
+                    for (int b = x + 1; b < n; b++)
+                        play(x, b, seed + 7919u * ((unsigned)x * (unsigned)n + (unsigned)b));
+                }
+            }, vector<int>());
+        }
+        graph.wait();
+    }
+
+    // Pair players with equal points where possible, avoiding rematches.
+    // Adds the round's matches plus the pairing task of the next round.
+    void pairSwissRound(TaskGraph *graph, int round, int rounds) {
+        if (round > rounds) return;
+
+        vector<int> order;
+        {
+            lock_guard<mutex> lock(m);
+            order = standingsLocked();
+        }
+
+        vector<int> deps;
+        vector<bool> paired(order.size(), false);
+        unsigned matchNo = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            if (paired[i]) continue;
+            paired[i] = true;
+
+            size_t j = i + 1;
+            while (j < order.size() && (paired[j] || opponents[order[i]].count(order[j]))) j++;
+            if (j == order.size()) {
+                // Fall back to a rematch, then to a bye worth a win
+                j = i + 1;
+                while (j < order.size() && paired[j]) j++;
+            }
+            if (j == order.size()) {
+                lock_guard<mutex> lock(m);
+                points[order[i]] += 2;
+                continue;
+            }
+            paired[j] = true;
+
+            int a = order[i], b = order[j];
+            opponents[a].insert(b);
+            opponents[b].insert(a);
+            unsigned matchSeed = seed + 104729u * (unsigned)round + 7919u * (++matchNo);
+            deps.push_back(graph->add([this, a, b, matchSeed] { play(a, b, matchSeed); }, vector<int>()));
+        }
+
+        graph->add([this, graph, round, rounds] { pairSwissRound(graph, round + 1, rounds); }, deps);
+    }
+
+    vector<int> standingsLocked() const {
+        vector<int> order(names.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+        stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            if (points[a] != points[b]) return points[a] > points[b];
+            return cardScore[a] > cardScore[b];
+        });
+        return order;
+    }
+
+public:
+    Tournament(ThreadPool &p, const vector<string> &playerNames,
+               int cards, int dist, unsigned eventSeed,
+               RatingStore *store = 0, MatchHistory *log = 0) : pool(p) {
+        ratings = store;
+        history = log;
+        names = playerNames;
+        cardsPerMatch = cards;
+        distMode = dist;
+        seed = eventSeed;
+        points.assign(names.size(), 0);
+        cardScore.assign(names.size(), 0);
+        opponents.assign(names.size(), set<int>());
+        matchesPlayed = 0;
+        champion = -1;
+    }
+
+    // Swiss rounds of 0 means ceil(log2(players))
+    void run(Format format, int swissRounds = 0) {
+        TaskGraph graph(pool);
+        if (format == SINGLE_ELIMINATION) {
+            runSingleElimination(graph);
+        } else if (format == ROUND_ROBIN) {
+            runRoundRobin(graph);
+        } else {
+            if (swissRounds <= 0)
+                while ((1 << swissRounds) < (int)names.size()) swissRounds++;
+            graph.add([this, &graph, swissRounds] { pairSwissRound(&graph, 1, swissRounds); }, vector<int>());
+            graph.wait();
+        }
+
+        if (format != SINGLE_ELIMINATION) champion = standings()[0];
+    }
+
+    vector<int> standings() {
+        lock_guard<mutex> lock(m);
+        return standingsLocked();
+    }
+
+    const string &getName(int i) const { return names[i]; }
+    int getPoints(int i) const { return points[i]; }
+    long long getCardScore(int i) const { return cardScore[i]; }
+    long long getMatchesPlayed() const { return matchesPlayed; }
+    int getChampion() const { return champion; }
+};
+
+// ===============================
+// MATCHMAKING
+// ===============================
+
+// Bounded multi-producer multi-consumer ring buffer without locks.
+// Each cell carries a sequence number telling producers and consumers
+// whose turn it is, so a push or pop is a single compare-and-swap.
+template <typename T>
+class LockFreeRing {
+private:
+    struct Cell {
+        atomic<size_t> seq;
+        T data;
+    };
+
+    vector<Cell> cells;
+    size_t mask;
+    atomic<size_t> head;   // Next slot to pop
+    atomic<size_t> tail;   // Next slot to push
+
+public:
+    // Capacity must be a power of two
+    LockFreeRing(size_t capacity) : cells(capacity) {
+        mask = capacity - 1;
+        for (size_t i = 0; i < capacity; i++) cells[i].seq.store(i, memory_order_relaxed);
+        head.store(0, memory_order_relaxed);
+        tail.store(0, memory_order_relaxed);
+    }
+
+    bool push(const T &value) {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true) {
+            Cell &c = cells[pos & mask];
+            size_t seq = c.seq.load(memory_order_acquire);
+            long long diff = (long long)seq - (long long)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    c.data = value;
+                    c.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T &value) {
+        size_t pos = head.load(memory_order_relaxed);
+        while (true) {
+            Cell &c = cells[pos & mask];
+            size_t seq = c.seq.load(memory_order_acquire);
+            long long diff = (long long)seq - (long long)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = c.data;
+                    c.seq.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Waiting players are filed into rating buckets. Arrivals push into the
+// bucket's lock-free ring from any thread. One matcher drains the rings
+// into its own FIFO per bucket, pairs players inside each bucket, and lets
+// a player who has waited long enough reach further out: one more bucket
+// on each side for every `widenMs` of waiting.
+class MatchmakingQueue {
+public:
+    struct Ticket {
+        string name;
+        double rating;
+        chrono::steady_clock::time_point since;
+    };
+
+private:
+    int bucketWidth;
+    int widenMs;
+    vector<unique_ptr<LockFreeRing<Ticket> > > rings;
+    vector<deque<Ticket> > waiting;   // Matcher thread only
+    size_t waitingTotal;
+
+    int bucketOf(double rating) const {
+        int b = (int)(rating / bucketWidth);
+        return max(0, min(b, (int)rings.size() - 1));
+    }
+
+public:
+    MatchmakingQueue(int width = 50, int widen = 250, double maxRating = 4000) {
+        bucketWidth = width;
+        widenMs = widen;
+        int count = (int)(maxRating / width) + 1;
+        for (int i = 0; i < count; i++) rings.push_back(unique_ptr<LockFreeRing<Ticket> >(new LockFreeRing<Ticket>(4096)));
+        waiting.resize(count);
+        waitingTotal = 0;
+    }
+
+    // Safe from any thread; false means the bucket is full, try again
+    bool enqueue(const string &name, double rating) {
+        Ticket t;
+        t.name = name;
+        t.rating = rating;
+        t.since = chrono::steady_clock::now();
+        return rings[bucketOf(rating)]->push(t);
+    }
+
+    // Matcher thread only: appends new pairs and returns how many were made
+    int poll(vector<pair<Ticket, Ticket> > &matches) {
+        int made = 0;
+        Ticket t;
+        for (size_t b = 0; b < rings.size(); b++) {
+            while (rings[b]->pop(t)) {
+                waiting[b].push_back(t);
+                waitingTotal++;
+            }
+            // Same bucket first, oldest players first
+            while (waiting[b].size() >= 2) {
+                matches.push_back(make_pair(waiting[b][0], waiting[b][1]));
+                waiting[b].pop_front();
+                waiting[b].pop_front();
+                waitingTotal -= 2;
+                made++;
+            }
+        }
+
+        // At most one player is left per bucket; widen their window over time
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        int n = (int)waiting.size();
+        for (int b = 0; b < n; b++) {
+            if (waiting[b].empty()) continue;
+            long long waitedMs = chrono::duration_cast<chrono::milliseconds>(now - waiting[b].front().since).count();
+            int reach = (int)(waitedMs / widenMs);
+            for (int d = 1; d <= reach && !waiting[b].empty(); d++) {
+                int near[2] = { b - d, b + d };
+                for (int k = 0; k < 2; k++) {
+                    int o = near[k];
+                    if (o < 0 || o >= n || waiting[o].empty()) continue;
+                    matches.push_back(make_pair(waiting[b].front(), waiting[o].front()));
+                    waiting[b].pop_front();
+                    waiting[o].pop_front();
+                    waitingTotal -= 2;
+                    made++;
+                    break;
+                }
+            }
+        }
+        return made;
+    }
+
+    // Players drained from the rings but not yet matched
+    size_t waitingCount() const { return waitingTotal; }
+};
+
+// ===============================
+// NETWORK SERVER
+// ===============================
+
+#ifdef __linux__
+
+// Coroutine type for a session's game flow. It starts running at once and
+// stays suspended after the last line so the session can destroy it.
+struct SessionTask {
+    struct promise_type {
+        SessionTask get_return_object() {
+            return SessionTask(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_never initial_suspend() noexcept { return suspend_never(); }
+        suspend_always final_suspend() noexcept { return suspend_always(); }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+
+    coroutine_handle<promise_type> handle;
+
+    SessionTask() : handle(nullptr) {}
+    explicit SessionTask(coroutine_handle<promise_type> h) : handle(h) {}
+    SessionTask(SessionTask &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    SessionTask &operator=(SessionTask &&other) noexcept {
+        if (handle) handle.destroy();
+        handle = other.handle;
+        other.handle = nullptr;
+        return *this;
+    }
+    SessionTask(const SessionTask &) = delete;
+    ~SessionTask() {
+        if (handle) handle.destroy();
+    }
+};
+
+class ServerSession;
+
+// A live match that spectators follow. Every message is built once and the
+// same immutable buffer is queued for every viewer, so fanning out costs a
+// pointer per viewer. Viewers get one delta line per round,
+//   D <round> <power1> <power2> <winner: 0, 1 or 2 for a draw>
+// from which scores and remaining cards follow, plus a keyframe
+//   K <match> <round> <score1> <score2> <left1> <left2> <name1>\t<name2>
+// every KEYFRAME_EVERY rounds. A late joiner gets the latest keyframe and
+// the deltas after it. The game ends with "E <score1> <score2>", after which
+// the viewers are sent back to the lobby.
+class MatchChannel {
+private:
+    static const int KEYFRAME_EVERY = 16;
+
+    mutex m;
+    ThreadPool &pool;        // Resumes viewers when the match ends
+    int id;
+    shared_ptr<const string> keyframe;
+    vector<shared_ptr<const string> > sinceKeyframe;
+    vector<weak_ptr<ServerSession> > viewers;
+    vector<shared_ptr<ServerSession> > queued;  // Viewers given output under the lock
+
+    // Under the lock a message is only queued; the sockets are written by
+    // flushQueued once the lock is released
+    void publishLocked(const shared_ptr<const string> &msg);
+    static void flushQueued(vector<shared_ptr<ServerSession> > &sessions);
+
+    void keyframeLocked(const Table &t, int round) {
+        stringstream ss;
+        ss << "K " << id << " " << round << " "
+           << t.getPlayer(0).getScore() << " " << t.getPlayer(1).getScore() << " "
+           << t.getPlayer(0).remainingCards() << " " << t.getPlayer(1).remainingCards() << " "
+           << t.getPlayer(0).getName() << "\t" << t.getPlayer(1).getName() << "\n";
+        keyframe = make_shared<const string>(ss.str());
+        sinceKeyframe.clear();
+        publishLocked(keyframe);
+    }
+
+public:
+    MatchChannel(ThreadPool &workers, int matchId) : pool(workers) { id = matchId; }
+
+    int getId() const { return id; }
+
+    void started(const Table &t) {
+        vector<shared_ptr<ServerSession> > sessions;
+        {
+            lock_guard<mutex> lock(m);
+            keyframeLocked(t, 0);
+            sessions.swap(queued);
+        }
+        flushQueued(sessions);
+    }
+
+    void roundPlayed(const Table &t, const Table::RoundResult &r) {
+        const vector<Card> &c = t.lastPlayed();
+        int round = t.getRoundNumber() - 1;
+        char line[64];
+        snprintf(line, sizeof(line), "D %d %d %d %d\n", round, c[0].getPower(), c[1].getPower(),
+                 r.winner < 0 ? 2 : r.winner);
+
+        vector<shared_ptr<ServerSession> > sessions;
+        {
+            lock_guard<mutex> lock(m);
+            shared_ptr<const string> msg = make_shared<const string>(line);
+            sinceKeyframe.push_back(msg);
+            publishLocked(msg);
+            if ((int)sinceKeyframe.size() >= KEYFRAME_EVERY) keyframeLocked(t, round);
+            sessions.swap(queued);
+        }
+        flushQueued(sessions);
+    }
+
+    void finished(const Table &t);
+    void addViewer(const shared_ptr<ServerSession> &viewer);
+    void removeViewer(const ServerSession *viewer);
+
+    int viewerCount() {
+        lock_guard<mutex> lock(m);
+        return (int)viewers.size();
+    }
+};
+
+// Registry of live matches by id
+class SpectatorHub {
+private:
+    mutex m;
+    ThreadPool &pool;
+    unordered_map<int, shared_ptr<MatchChannel> > live;
+    int nextId;
+
+public:
+    SpectatorHub(ThreadPool &workers) : pool(workers) { nextId = 1; }
+
+    shared_ptr<MatchChannel> open() {
+        lock_guard<mutex> lock(m);
+        shared_ptr<MatchChannel> c(new MatchChannel(pool, nextId++));
+        live[c->getId()] = c;
+        return c;
+    }
+
+    void close(int id) {
+        lock_guard<mutex> lock(m);
+        live.erase(id);
+    }
+
+    shared_ptr<MatchChannel> find(int id) {
+        lock_guard<mutex> lock(m);
+        unordered_map<int, shared_ptr<MatchChannel> >::iterator it = live.find(id);
+        return it == live.end() ? shared_ptr<MatchChannel>() : it->second;
+    }
+
+    vector<int> ids() {
+        lock_guard<mutex> lock(m);
+        vector<int> out;
+        for (unordered_map<int, shared_ptr<MatchChannel> >::iterator it = live.begin(); it != live.end(); ++it)
+            out.push_back(it->first);
+        sort(out.begin(), out.end());
+        return out;
+    }
+};
+
+// One connected client playing against the computer, or watching a match.
+// The game flow is a coroutine that co_awaits each line of input, so an
+// idle session is just this object plus a small suspended frame; no thread
+// waits on it. The event loop appends raw bytes to `inbox`, and a worker
+// resumes the coroutine when a full line is there, one worker at a time
+// per session. Replies go straight to the non-blocking socket; whatever
+// does not fit waits in `out` until the loop sees EPOLLOUT.
+class ServerSession : public enable_shared_from_this<ServerSession> {
+public:
+    static const int MAX_CARDS = 1000000;        // Largest game a client may ask for
+    static const size_t MAX_INBOX = 64 * 1024;   // Longest unread input before we hang up
+    static const int MAX_BAD_ANSWERS = 5;        // Invalid settings in a row before we hang up
+
+    int fd;
+    int epfd;
+    mutex m;                 // Guards output, inbox, scheduled, waiting
+    vector<shared_ptr<const string> > out;  // Queued messages, possibly shared
+    size_t outHead;          // First message not fully sent
+    size_t outOffset;        // Bytes of out[outHead] already sent
+    string inbox;            // Raw input not yet consumed
+    bool scheduled;          // A worker is resuming this session
+    bool closed;             // The client hung up; the flow is never resumed again
+    bool watchOver;          // The match this viewer watches has ended
+    bool writeArmed;         // EPOLLOUT is requested for fd
+
+private:
+    coroutine_handle<> waiting;  // Set while suspended on input
+    string line;                 // Line handed to the coroutine
+    string name;
+    unsigned seed;           // Deck seed; an mt19937 only lives while dealing
+    Table table;
+    RatingStore &ratings;
+    MatchHistory &history;
+    SpectatorHub &hub;
+    shared_ptr<MatchChannel> channel;  // Our match, while one is running
+    int totalCards, distMode;          // Settings of that match
+    SessionTask task;
+
+    // Move one complete line from inbox to `line`; caller holds m. A viewer
+    // whose match has ended reads "/quit", which takes it back to the lobby.
+    bool takeLineLocked() {
+        if (watchOver) {
+            line = "/quit";
+            return true;
+        }
+        size_t nl = inbox.find('\n');
+        if (nl == string::npos) return false;
+        line = inbox.substr(0, nl);
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        inbox.erase(0, nl + 1);
+        return true;
+    }
+
+    struct LineAwaiter {
+        ServerSession *s;
+
+        bool await_ready() {
+            lock_guard<mutex> lock(s->m);
+            return s->takeLineLocked();
+        }
+
+        // Re-check under the lock: input may have arrived since await_ready
+        bool await_suspend(coroutine_handle<> h) {
+            lock_guard<mutex> lock(s->m);
+            if (s->takeLineLocked()) return false;
+            s->waiting = h;
+            return true;
+        }
+
+        string await_resume() { return s->line; }
+    };
+
+    LineAwaiter nextLine() {
+        LineAwaiter a;
+        a.s = this;
+        return a;
+    }
+
+    void send(const string &text) { sendShared(make_shared<const string>(text)); }
+
+    void playAndReport() {
+        Table::RoundResult r = table.playRound();
+        channel->roundPlayed(table, r);
+        const vector<Card> &c = table.lastPlayed();
+        stringstream ss;
+        ss << "\n===== ROUND " << (table.getRoundNumber() - 1) << " =====\n"
+           << name << " plays: " << c[0].getName() << " (" << c[0].getRarity()
+           << " | Power: " << c[0].getPower() << ")\n"
+           << "Computer plays: " << c[1].getName() << " (" << c[1].getRarity()
+           << " | Power: " << c[1].getPower() << ")\n";
+        if (r.winner == 0) ss << name << " wins this round!\n";
+        else if (r.winner == 1) ss << "Computer wins this round!\n";
+        else ss << "It's a draw. Each keeps their card.\n";
+        send(ss.str());
+    }
+
+    void finish() {
+        int s1 = table.getPlayer(0).getScore(), s2 = table.getPlayer(1).getScore();
+        stringstream ss;
+        ss << "\n===== FINAL RESULT =====\n" << name << " score: " << s1
+           << "\nComputer score: " << s2 << "\n";
+        if (s1 > s2) ss << "WINNER: " << name << "\n";
+        else if (s2 > s1) ss << "WINNER: Computer\n";
+        else ss << "MATCH DRAW\n";
+        ratings.recordResult(ratingKey(name), "Computer", s1 > s2 ? 1.0 : (s2 > s1 ? 0.0 : 0.5));
+        history.record(name, "Computer", s1, s2, totalCards, distMode, MatchHistory::SERVER);
+        send(ss.str());
+
+        channel->finished(table);
+        hub.close(channel->getId());
+        channel.reset();
+    }
+
+    SessionTask flow() {
+        send("===== CARD BATTLE GAME =====\n"
+             "Enter your name (or /list, /watch <match>): ");
+        name = co_await nextLine();
+
+        // Spectators stay in this loop until they stop watching
+        while (name == "/list" || name.compare(0, 7, "/watch ") == 0) {
+            if (name == "/list") {
+                vector<int> ids = hub.ids();
+                stringstream ss;
+                ss << ids.size() << " live matches:";
+                for (size_t i = 0; i < ids.size() && i < 100; i++) ss << " " << ids[i];
+                send(ss.str() + "\n");
+            } else {
+                shared_ptr<MatchChannel> watched = hub.find(atoi(name.c_str() + 7));
+                if (!watched) {
+                    send("No live match with that number.\n");
+                } else {
+                    watched->addViewer(shared_from_this());
+                    while (co_await nextLine() != "/quit") {}
+                    watched->removeViewer(this);
+
+                    bool ended;
+                    {
+                        lock_guard<mutex> lock(m);
+                        ended = watchOver;
+                        watchOver = false;
+                    }
+                    if (ended) send("Match " + intToString(watched->getId()) + " has ended.\n");
+                }
+            }
+            send("Enter your name (or /list, /watch <match>): ");
+            name = co_await nextLine();
+        }
+        if (name.empty()) name = "Player1";
+
+        while (true) {
+            int bad = 0;
+            totalCards = 0;
+            while (bad < MAX_BAD_ANSWERS) {
+                send("Total number of cards (even, 4-" + intToString(MAX_CARDS) + "): ");
+                totalCards = atoi((co_await nextLine()).c_str());
+                if (totalCards >= 4 && totalCards <= MAX_CARDS) break;
+                send("Please choose between 4 and " + intToString(MAX_CARDS) + " cards.\n");
+                bad++;
+            }
+            totalCards -= totalCards % 2;
+
+            distMode = 0;
+            while (bad < MAX_BAD_ANSWERS) {
+                send("Distribution (1. Alternate  2. Halves  3. Random): ");
+                distMode = atoi((co_await nextLine()).c_str());
+                if (distMode >= 1 && distMode <= 3) break;
+                bad++;
+            }
+
+            if (bad == MAX_BAD_ANSWERS) {
+                send("Too many invalid answers; closing the connection.\n");
+                shutdown(fd, SHUT_RD);
+                co_return;
+            }
+
+            vector<string> names;
+            names.push_back(name);
+            names.push_back("Computer");
+            table.setPlayers(names);
+            {
+                mt19937 rng(seed++);
+                table.deal(makeCardPool(totalCards, rng), distMode, rng);
+            }
+            channel = hub.open();
+            channel->started(table);
+            send("Decks are ready! " + intToString(totalCards / 2) + " cards each.\n"
+                 "Spectators can join with: /watch " + intToString(channel->getId()) + "\n");
+
+            while (!table.isOver()) {
+                send("\n1. Play next round\n2. View scores\n3. View remaining cards\n0. End game now\n> ");
+                string ch = co_await nextLine();
+                if (ch == "1") {
+                    playAndReport();
+                } else if (ch == "2" || ch == "3") {
+                    stringstream ss;
+                    for (int i = 0; i < 2; i++) {
+                        const Player &pl = table.getPlayer(i);
+                        ss << pl.getName() << ": " << (ch == "2" ? pl.getScore() : pl.remainingCards()) << "\n";
+                    }
+                    send(ss.str());
+                } else if (ch == "0") {
+                    break;
+                }
+            }
+
+            finish();
+            send("Play again? (y/n)\n> ");
+            string again = co_await nextLine();
+            if (again.empty() || (again[0] != 'y' && again[0] != 'Y')) break;
+        }
+
+        send("Thanks for playing Card Battle Game!\n");
+        shutdown(fd, SHUT_RD);
+    }
+
+public:
+    ServerSession(int socketFd, int epollFd, RatingStore &store, MatchHistory &log,
+                  SpectatorHub &spectators, unsigned deckSeed)
+        : ratings(store), history(log), hub(spectators) {
+        totalCards = 0;
+        distMode = 1;
+        fd = socketFd;
+        epfd = epollFd;
+        outHead = 0;
+        outOffset = 0;
+        scheduled = false;
+        closed = false;
+        watchOver = false;
+        writeArmed = false;
+        seed = deckSeed;
+    }
+
+    // A player who disconnects mid-game ends the broadcast
+    ~ServerSession() {
+        if (channel) {
+            channel->finished(table);
+            hub.close(channel->getId());
+        }
+        close(fd);
+    }
+
+    // Queue a message, possibly shared with other sessions, and send what fits
+    void sendShared(const shared_ptr<const string> &msg) {
+        lock_guard<mutex> lock(m);
+        out.push_back(msg);
+        flushLocked();
+    }
+
+    // Queue only; a later flush() writes it
+    void queueShared(const shared_ptr<const string> &msg) {
+        lock_guard<mutex> lock(m);
+        out.push_back(msg);
+    }
+
+    void flush() {
+        lock_guard<mutex> lock(m);
+        flushLocked();
+    }
+
+    // Runs the flow up to its first wait for input
+    void start() { task = flow(); }
+
+    // The watched match ended. Returns true if the caller should hand the
+    // session to a worker, which then reads "/quit" from takeLineLocked.
+    bool endWatch() {
+        lock_guard<mutex> lock(m);
+        watchOver = true;
+        if (closed || scheduled || !waiting) return false;
+        scheduled = true;
+        return true;
+    }
+
+    // Write as much of `out` as the socket takes; ask for EPOLLOUT otherwise
+    void flushLocked() {
+        while (outHead < out.size()) {
+            iovec iov[64];
+            int count = 0;
+            for (size_t i = outHead; i < out.size() && count < 64; i++, count++) {
+                size_t skip = (i == outHead) ? outOffset : 0;
+                iov[count].iov_base = (void *)(out[i]->data() + skip);
+                iov[count].iov_len = out[i]->size() - skip;
+            }
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+
+            ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+
+            size_t sent = (size_t)n;
+            while (sent > 0) {
+                size_t left = out[outHead]->size() - outOffset;
+                if (sent >= left) {
+                    sent -= left;
+                    out[outHead++].reset();
+                    outOffset = 0;
+                } else {
+                    outOffset += sent;
+                    sent = 0;
+                }
+            }
+        }
+        // Drop sent messages once they are most of the queue, so a viewer
+        // that always lags a little does not keep every message it was sent
+        if (outHead == out.size()) {
+            out.clear();
+            outHead = 0;
+        } else if (outHead >= 64 && outHead * 2 >= out.size()) {
+            out.erase(out.begin(), out.begin() + outHead);
+            outHead = 0;
+        }
+
+        // Only touch epoll when EPOLLOUT has to be turned on or off
+        if (out.empty() == !writeArmed) return;
+        writeArmed = !out.empty();
+        epoll_event ev;
+        ev.events = EPOLLIN | (writeArmed ? (unsigned)EPOLLOUT : 0u);
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    // Worker: resume the flow for as long as it has input to consume
+    void pump() {
+        while (true) {
+            coroutine_handle<> h;
+            {
+                lock_guard<mutex> lock(m);
+                if (closed || !waiting || !takeLineLocked()) {
+                    scheduled = false;
+                    return;
+                }
+                h = waiting;
+                waiting = nullptr;
+            }
+            h.resume();
+        }
+    }
+};
+
+void MatchChannel::publishLocked(const shared_ptr<const string> &msg) {
+    size_t kept = 0;
+    for (size_t i = 0; i < viewers.size(); i++) {
+        shared_ptr<ServerSession> v = viewers[i].lock();
+        if (!v) continue;
+        v->queueShared(msg);
+        queued.push_back(v);
+        viewers[kept++] = viewers[i];
+    }
+    viewers.resize(kept);
+}
+
+void MatchChannel::flushQueued(vector<shared_ptr<ServerSession> > &sessions) {
+    for (size_t i = 0; i < sessions.size(); i++) sessions[i]->flush();
+}
+
+// Viewers are flagged while still listed, so one that leaves on its own
+// at the same moment never sees a stale flag in its next watch
+void MatchChannel::finished(const Table &t) {
+    vector<shared_ptr<ServerSession> > sessions, resume;
+    {
+        lock_guard<mutex> lock(m);
+        publishLocked(make_shared<const string>("E " + intToString(t.getPlayer(0).getScore()) + " " +
+                                                intToString(t.getPlayer(1).getScore()) + "\n"));
+        sessions.swap(queued);
+        for (size_t i = 0; i < sessions.size(); i++)
+            if (sessions[i]->endWatch()) resume.push_back(sessions[i]);
+        viewers.clear();
+    }
+    flushQueued(sessions);
+    for (size_t i = 0; i < resume.size(); i++) {
+        shared_ptr<ServerSession> v = resume[i];
+        pool.submit([v] { v->pump(); });
+    }
+}
+
+void MatchChannel::addViewer(const shared_ptr<ServerSession> &viewer) {
+    {
+        lock_guard<mutex> lock(m);
+        viewers.push_back(viewer);
+        if (keyframe) viewer->queueShared(keyframe);
+        for (size_t i = 0; i < sinceKeyframe.size(); i++) viewer->queueShared(sinceKeyframe[i]);
+    }
+    viewer->flush();
+}
+
+void MatchChannel::removeViewer(const ServerSession *viewer) {
+    lock_guard<mutex> lock(m);
+    for (size_t i = 0; i < viewers.size(); i++) {
+        shared_ptr<ServerSession> v = viewers[i].lock();
+        if (!v || v.get() == viewer) {
+            viewers.erase(viewers.begin() + i);
+            i--;
+        }
+    }
+}
+
+volatile sig_atomic_t serverStopRequested = 0;
+
+void onServerSignal(int) { serverStopRequested = 1; }
+
+// Single epoll loop accepting TCP and Unix socket clients; game logic runs
+// on the worker pool so a slow session never stalls the loop.
+class GameServer {
+private:
+    ThreadPool &pool;
+    RatingStore &ratings;
+    MatchHistory &history;
+    SpectatorHub hub;
+    int epfd;
+    vector<int> listeners;
+    unordered_map<int, shared_ptr<ServerSession> > sessions;
+    unsigned nextSeed;
+
+    static void setNonBlocking(int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    void addListener(int fd) {
+        setNonBlocking(fd);
+        listen(fd, 1024);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        listeners.push_back(fd);
+    }
+
+    void acceptAll(int listener) {
+        while (true) {
+            int fd = accept(listener, 0, 0);
+            if (fd < 0) return;
+            setNonBlocking(fd);
+
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+
+            shared_ptr<ServerSession> s(new ServerSession(fd, epfd, ratings, history, hub, nextSeed++));
+            sessions[fd] = s;
+            s->start();
+        }
+    }
+
+    // Hand the session to a worker unless one is already on it
+    void schedule(shared_ptr<ServerSession> s) {
+        {
+            lock_guard<mutex> lock(s->m);
+            if (s->scheduled || s->inbox.find('\n') == string::npos) return;
+            s->scheduled = true;
+        }
+        pool.submit([s] { s->pump(); });
+    }
+
+    void drop(int fd) {
+        unordered_map<int, shared_ptr<ServerSession> >::iterator it = sessions.find(fd);
+        if (it != sessions.end()) {
+            lock_guard<mutex> lock(it->second->m);
+            it->second->closed = true;
+        }
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, 0);
+        sessions.erase(fd); // Socket closes when the last worker lets go
+    }
+
+    void onReadable(shared_ptr<ServerSession> s) {
+        char buf[4096];
+        while (true) {
+            ssize_t n = recv(s->fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                bool flooded;
+                {
+                    lock_guard<mutex> lock(s->m);
+                    s->inbox.append(buf, (size_t)n);
+                    flooded = s->inbox.size() > ServerSession::MAX_INBOX;
+                }
+                if (flooded) {
+                    s->sendShared(make_shared<const string>("Input too long; closing the connection.\n"));
+                    drop(s->fd);
+                    return;
+                }
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                drop(s->fd);
+                return;
+            }
+        }
+        schedule(s);
+    }
+
+public:
+    GameServer(ThreadPool &p, RatingStore &store, MatchHistory &log)
+        : pool(p), ratings(store), history(log), hub(p) {
+        epfd = epoll_create1(0);
+        nextSeed = (unsigned)rand();
+    }
+
+    ~GameServer() {
+        sessions.clear();
+        for (size_t i = 0; i < listeners.size(); i++) close(listeners[i]);
+        close(epfd);
+    }
+
+    // Listen on 127.0.0.1:port
+    bool listenTcp(int port) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return false;
+        }
+        addListener(fd);
+        return true;
+    }
+
+    bool listenUnix(const string &path) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(path.c_str());
+        if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return false;
+        }
+        addListener(fd);
+        return true;
+    }
+
+    // Run until SIGINT or SIGTERM
+    void run() {
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, onServerSignal);
+        signal(SIGTERM, onServerSignal);
+
+        vector<epoll_event> events(1024);
+        while (!serverStopRequested) {
+            int n = epoll_wait(epfd, &events[0], (int)events.size(), 500);
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (find(listeners.begin(), listeners.end(), fd) != listeners.end()) {
+                    acceptAll(fd);
+                    continue;
+                }
+
+                unordered_map<int, shared_ptr<ServerSession> >::iterator it = sessions.find(fd);
+                if (it == sessions.end()) continue;
+                shared_ptr<ServerSession> s = it->second;
+
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    drop(fd);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    lock_guard<mutex> lock(s->m);
+                    s->flushLocked();
+                }
+                if (events[i].events & EPOLLIN) onReadable(s);
+            }
+        }
+        pool.waitIdle();
+    }
+
+    int sessionCount() const { return (int)sessions.size(); }
+};
+
+#endif
+
+// ===============================
+// LOCKSTEP LINK
+// ===============================
+
+// Point-to-point link for networked Player vs Player.
+// Both sides run the same seeded game, so only the seed, settings and
+// names go over the wire once, then a few bytes per round.
+class PeerLink {
+private:
+    int fd;
+
+public:
+    PeerLink() { fd = -1; }
+    ~PeerLink() { disconnect(); }
+
+    bool isOpen() const { return fd >= 0; }
+
+#ifdef __linux__
+    // Host side: wait for one opponent on 127.0.0.1:port
+    bool host(int port) {
+        int lfd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(lfd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0) {
+            close(lfd);
+            return false;
+        }
+        fd = accept(lfd, 0, 0);
+        close(lfd);
+        return fd >= 0;
+    }
+
+    bool join(int port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            disconnect();
+            return false;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        return true;
+    }
+
+    bool sendAll(const void *data, size_t size) {
+        const char *p = (const char *)data;
+        while (size > 0) {
+            ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    bool recvAll(void *data, size_t size) {
+        char *p = (char *)data;
+        while (size > 0) {
+            ssize_t n = recv(fd, p, size, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+#else
+    bool host(int) { return false; }
+    bool join(int) { return false; }
+    bool sendAll(const void *, size_t) { return false; }
+    bool recvAll(void *, size_t) { return false; }
+    void disconnect() {}
+#endif
+
+    bool sendString(const string &text) {
+        uint32_t len = (uint32_t)text.size();
+        return sendAll(&len, 4) && sendAll(text.data(), text.size());
+    }
+
+    bool recvString(string &text) {
+        uint32_t len;
+        if (!recvAll(&len, 4) || len > 4096) return false;
+        text.resize(len);
+        return len == 0 || recvAll(&text[0], len);
+    }
+};
+
+// ===============================
+// GAME EVENTS
+// ===============================
+
+// What the game core reports; the console, stats and logs listen to these
+struct GameEvent {
+    enum Type { DEAL_START, DEAL_DONE, ROUND_START, AI_THINKING, CARD_HIDDEN,
+                CARD_PLAYED, ROUND_RESULT, GAME_OVER };
+
+    Type type;
+    int round;
+    int player;      // Who played or thought; the winner (-1 draw) for results
+    Card card;       // CARD_PLAYED
+    int count[2];    // Cards left (DEAL_DONE, ROUND_RESULT) or final scores
+    bool solved;     // DEAL_DONE: the hidden hand is solved exactly...
+    double value;    // ...with this expected score difference for player 2
+
+    GameEvent(Type t = DEAL_START, int r = 0, int who = -1) {
+        type = t;
+        round = r;
+        player = who;
+        count[0] = count[1] = 0;
+        solved = false;
+        value = 0;
+    }
+};
+
+// Events are queued and handed to every subscriber as one batch on flush().
+// With no subscribers emit() drops the event, so a headless game does no
+// output work at all.
+class EventBus {
+public:
+    typedef function<void(const vector<GameEvent> &)> Handler;
+
+private:
+    vector<pair<int, Handler> > handlers;
+    vector<GameEvent> pending;
+    int nextId;
+
+public:
+    EventBus() { nextId = 1; }
+
+    int subscribe(const Handler &h) {
+        handlers.push_back(make_pair(nextId, h));
+        return nextId++;
+    }
+
+    void unsubscribe(int id) {
+        for (size_t i = 0; i < handlers.size(); i++) {
+            if (handlers[i].first == id) {
+                handlers.erase(handlers.begin() + i);
+                return;
+            }
+        }
+    }
+
+    bool hasSubscribers() const { return !handlers.empty(); }
+
+    void emit(const GameEvent &e) {
+        if (!handlers.empty()) pending.push_back(e);
+    }
+
+    void flush() {
+        if (pending.empty()) return;
+        vector<GameEvent> batch;
+        batch.swap(pending);
+        for (size_t i = 0; i < handlers.size(); i++) handlers[i].second(batch);
+    }
+};
+
+// ===============================
+// GAME CLASS
+// ===============================
+
+class Game {
+private:
+    static const int MAX_CARDS = 1000000;  // Largest two-player game
+
+    vector<Card> cardPool;  // All generated cards
+    Player p1, p2;
+    bool vsComputer;        // Mode flag
+    bool handMode;          // Players choose cards from a hand
+    bool hiddenHand;        // Computer commits first without seeing the human's card
+    bool tableMode;         // N-player table instead of p1 vs p2
+    Table table;
+    int roundNumber;
+    TianJiPlanner planner;  // Computer's plan in open-hand mode
+    MctsPlanner mcts;       // Computer's search in hidden-hand mode
+    ExpectimaxSolver solver; // Exact play for small hidden hands
+    RatingStore ratings;    // Persistent player ratings
+    MatchHistory history;   // Every finished match
+    int gameCards;          // Settings of the current two-player game
+    int gameDistMode;
+    RaritySettings raritySettings; // Chosen in the start menu
+    RaritySettings dealRarity;     // Used for the current deal (a host's, when joining)
+    int buildSlots;                // Deck building: cards per deck and power budget
+    int buildBudget;
+    mt19937 rng;            // Deals; seeded per game so a seed replays a deal
+    bool networkMode;       // Lockstep Player vs Player over a socket
+    PeerLink peer;
+    uint64_t stateHash;     // Running hash of the deal and every round
+    uint32_t saveGeneration; // Snapshot the round journal belongs to
+    bool useSolver;
+    EventBus events;        // Game progress; the console view subscribes
+    vector<string> lastRound; // The table's lines about the round just played
+
+    // State after every round of a draw-mode game, for undo. Decks and won
+    // piles are persistent, so each entry shares all but O(1) cells with
+    // the one before it.
+    struct Turn {
+        PlayerState a, b;
+        int round;
+        uint64_t hash;
+    };
+    vector<Turn> timeline;
+    bool autoPlaying;       // Rounds run without prompts, rendering or journal
+    int handFocus;          // Hand position of the human's last pick, for the hand window
+    int consoleView;        // Subscription id of the console view, 0 when detached
+
+public:
+    Game() {
+        vsComputer = true;
+        handMode = false;
+        hiddenHand = false;
+        useSolver = false;
+        tableMode = false;
+        networkMode = false;
+        stateHash = 0;
+        saveGeneration = generationOnDisk();
+        gameCards = 0;
+        gameDistMode = 1;
+        buildSlots = 0;
+        buildBudget = 0;
+        roundNumber = 1;
+        rng.seed((unsigned)rand());
+        autoPlaying = false;
+        handFocus = 0;
+        consoleView = 0;
+        attachConsoleView();
+    }
+
+    void attachConsoleView() {
+        if (consoleView) return;
+        consoleView = events.subscribe([this](const vector<GameEvent> &batch) {
+            for (size_t i = 0; i < batch.size(); i++) renderEvent(batch[i]);
+        });
+    }
+
+    void detachConsoleView() {
+        events.unsubscribe(consoleView);
+        consoleView = 0;
+    }
+
+    // Console view of the game, driven by the event bus
+    void renderEvent(const GameEvent &e) {
+        const Player &who = e.player == 1 ? p2 : p1;
+        switch (e.type) {
+        case GameEvent::DEAL_START:
+            clearScreen();
+            cout << CYAN << "Generating cards...\n" << RESET;
+            break;
+
+        case GameEvent::DEAL_DONE:
+            lastRound.clear();
+            clearScreen();
+            cout << GREEN << "Decks are ready!\n\n" << RESET;
+            cout << p1.getName() << " has " << e.count[0] << " cards.\n";
+            cout << p2.getName() << " has " << e.count[1] << " cards.\n";
+            if (e.solved)
+                cout << MAGENTA << "\nSolved deal: expected score difference for "
+                     << p2.getName() << " is " << e.value << "\n" << RESET;
+            break;
+
+        case GameEvent::ROUND_START:
+            lastRound.clear();
+            break;
+
+        case GameEvent::AI_THINKING:
+            cout << MAGENTA << who.getName() << " is thinking...\n" << RESET;
+            break;
+
+        case GameEvent::CARD_HIDDEN:
+            cout << MAGENTA << who.getName() << " has placed a card face down.\n\n" << RESET;
+            break;
+
+        case GameEvent::CARD_PLAYED:
+            lastRound.push_back(GREEN + who.getName() + " plays: " + RESET + e.card.describe());
+            break;
+
+        case GameEvent::ROUND_RESULT:
+            if (e.player >= 0)
+                lastRound.push_back(GREEN + who.getName() + " wins this round!" + RESET);
+            else
+                lastRound.push_back(MAGENTA + string("It's a draw. Each keeps their card.") + RESET);
+
+            // The last round of a game is shown before the final result
+            // takes over the screen
+            if (e.count[0] == 0 || e.count[1] == 0) drawTable(false);
+            break;
+
+        case GameEvent::GAME_OVER: {
+            clearScreen();
+            cout << CYAN << "========== FINAL RESULT ==========" << RESET << "\n";
+            cout << p1.getName() << " score: " << e.count[0] << "\n";
+            cout << p2.getName() << " score: " << e.count[1] << "\n";
+
+            if (e.player >= 0)
+                cout << GREEN << "\nWINNER: " << who.getName() << " \n" << RESET;
+            else
+                cout << MAGENTA << "\nMATCH DRAW \n" << RESET;
+
+            Rating r1 = ratings.get(ratingKey(p1.getName())), r2 = ratings.get(ratingKey(p2.getName()));
+            cout << CYAN << "\nRatings (Elo / Glicko):\n" << RESET;
+            cout << p1.getName() << ": " << (int)r1.elo << " / " << (int)r1.glicko << " +/- " << (int)r1.rd << "\n";
+            cout << p2.getName() << ": " << (int)r2.elo << " / " << (int)r2.glicko << " +/- " << (int)r2.rd << "\n";
+            break;
+        }
+        }
+    }
+
+    // Show title screen
+    void showTitleScreen() {
+        clearScreen();
+        cout << CYAN;
+        cout << "=====================================\n";
+        cout << "           CARD BATTLE GAME          \n";
+        cout << "=====================================\n";
+        cout << "       A DSA-based Console Game      \n";
+        cout << "-------------------------------------\n\n";
+        cout << RESET;
+    }
+
+    // Main menu before game
+    int showStartMenu() {
+        int choice = -1;
+        do {
+            cout << YELLOW << "1. Start New Game\n2. Run Tournament\n3. Leaderboard\n4. Matchmaking Simulation\n";
+            if (hasSave()) cout << "5. Resume Saved Game\n";
+            cout << "6. Match History\n7. Card Rarity Settings\n0. Exit\nEnter choice: " << RESET;
+            cin >> choice;
+
+            if (cin.fail()) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                choice = -1;
+            }
+        } while (choice < 0 || choice > 7 || (choice == 5 && !hasSave()));
+
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        return choice;
+    }
+
+    // Choose PvP or PvC mode
+    void chooseMode() {
+        int mode = -1;
+        do {
+            clearScreen();
+            cout << CYAN << "Choose Game Mode:\n" << RESET;
+            cout << YELLOW << "1. Player vs Computer\n2. Player vs Player\n"
+                 << "3. Player vs Computer (Hand mode)\n"
+                 << "4. Player vs Computer (Hidden hand)\n"
+                 << "5. Multiplayer Table (3+ players)\n"
+                 << "6. Player vs Player (Network)\nEnter choice: " << RESET;
+            cin >> mode;
+
+            if (cin.fail()) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                mode = -1;
+            }
+        } while (mode < 1 || mode > 6);
+
+        tableMode = (mode == 5);
+        networkMode = (mode == 6);
+        vsComputer = (mode != 2 && mode != 6);
+        handMode = (mode == 3 || mode == 4);
+        hiddenHand = (mode == 4);
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+
+    // Player names setup
+    void setupPlayers() {
+        clearScreen();
+        string name;
+
+        cout << CYAN << "Enter Player 1 name: " << RESET;
+        getline(cin, name);
+        if (name.empty()) name = "Player1";
+        p1.setName(name);
+
+        if (vsComputer) {
+            p2.setName("Computer");
+        } else {
+            cout << CYAN << "Enter Player 2 name: " << RESET;
+            getline(cin, name);
+            if (name.empty()) name = "Player2";
+            p2.setName(name);
+        }
+
+        clearScreen();
+        cout << GREEN << "Match Setup:\n" << RESET;
+        cout << GREEN << p1.getName() << RESET << "  VS  "
+             << GREEN << p2.getName() << RESET << "\n";
+        waitForEnter();
+    }
+
+    // Card count + distribution settings
+    void askGameSettings(int &totalCards, int &distMode) {
+        clearScreen();
+        do {
+            cout << YELLOW << "Enter TOTAL number of cards (even number, 4-" << MAX_CARDS << "): " << RESET;
+            cin >> totalCards;
+
+            if (cin.fail()) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                totalCards = -1;
+            }
+        } while (totalCards < 4 || totalCards > MAX_CARDS);
+
+        if (totalCards % 2 != 0) {
+            totalCards--;
+            cout << MAGENTA << "Adjusted to even total: " << totalCards << RESET << "\n";
+        }
+
+        do {
+            cout << CYAN << "\nChoose card distribution style:\n" << RESET;
+            cout << YELLOW << "1. Alternate dealing\n2. First half to P1\n3. Random equal\n"
+                 << "4. Build decks under a power budget\n5. Draft from a shared pool\n"
+                 << "6. Fair split (matched power and rarities)\nEnter choice: " << RESET;
+            cin >> distMode;
+
+            if (cin.fail()) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                distMode = -1;
+            }
+        } while (distMode < 1 || distMode > 6);
+
+        // Each player builds a deck from their half of the cards
+        if (distMode == 4) {
+            buildSlots = -1;
+            do {
+                cout << YELLOW << "\nCards per deck (1-" << totalCards / 2 << "): " << RESET;
+                cin >> buildSlots;
+
+                if (cin.fail()) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    buildSlots = -1;
+                }
+            } while (buildSlots < 1 || buildSlots > totalCards / 2);
+
+            buildBudget = -1;
+            do {
+                cout << YELLOW << "Total power allowed per deck (about " << buildSlots * 55
+                     << " for an average deck): " << RESET;
+                cin >> buildBudget;
+
+                if (cin.fail()) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    buildBudget = -1;
+                }
+            } while (buildBudget < 1);
+        }
+
+        if (hiddenHand) {
+            int budget = -1;
+            do {
+                cout << YELLOW << "\nComputer thinking time per move in ms (10-10000): " << RESET;
+                cin >> budget;
+
+                if (cin.fail()) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    budget = -1;
+                }
+            } while (budget < 10 || budget > 10000);
+            mcts.setBudgetMs(budget);
+        }
+
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+        clearScreen();
+        cout << CYAN << "Game Settings:\n" << RESET;
+        cout << YELLOW << "Total cards: " << totalCards << "\nDistribution mode: " << distMode << RESET << "\n";
+        if (distMode == 4)
+            cout << YELLOW << "Deck: " << buildSlots << " cards, at most " << buildBudget << " power" << RESET << "\n";
+        waitForEnter();
+    }
+
+    // Convert power to rarity
+    string getRarity(int power) {
+        return rarityForPower(power);
+    }
+
+    // Fill cardPool with random cards in random order
+    void generateCardPool(int totalCards) {
+        cardPool = makeCardPool(totalCards, rng, dealRarity);
+    }
+
+    // Build a deck of buildSlots cards from a collection within the power
+    // budget. People pick cards page by page and can let the DeckBuilder fill
+    // the rest; the computer and both sides of a network game take its deck.
+    vector<Card> buildDeck(const Player &pl, vector<Card> collection) {
+        const int PAGE = 20;
+        sort(collection.begin(), collection.end(),
+             [](const Card &a, const Card &b) { return a.getPower() > b.getPower(); });
+        int n = (int)collection.size(), slots = min(buildSlots, n);
+        vector<int> powers(n);
+        for (int i = 0; i < n; i++) powers[i] = collection[i].getPower();
+
+        // A budget below the cheapest full deck is raised to that deck's power
+        long long budget = buildBudget, cheapest = 0;
+        for (int i = n - slots; i < n; i++) cheapest += powers[i];
+        string message;
+        if (cheapest > budget) {
+            message = "No deck of " + intToString(slots) + " cards fits the budget; allowing " +
+                      intToString((int)cheapest) + " power.";
+            budget = cheapest;
+        }
+
+        vector<char> picked(n, 0);
+        int count = 0, page = 0, pages = (n + PAGE - 1) / PAGE;
+        long long used = 0;
+        bool person = !networkMode && !(vsComputer && &pl == &p2);
+        bool done = !person;
+
+        while (!done) {
+            clearScreen();
+            cout << CYAN << "======== DECK BUILDING: " << pl.getName() << " ========\n" << RESET;
+            cout << YELLOW << "Deck: " << count << "/" << slots << " cards   Power: " << used << "/" << budget
+                 << RESET << "\n\n";
+            for (int i = page * PAGE; i < n && i < (page + 1) * PAGE; i++)
+                cout << (picked[i] ? GREEN "* " RESET : "  ") << YELLOW << (i + 1) << ". " << RESET
+                     << collection[i].describe() << "\n";
+            if (!message.empty()) cout << "\n" << MAGENTA << message << RESET << "\n";
+            message.clear();
+
+            cout << YELLOW << "\nPage " << page + 1 << "/" << pages
+                 << ". Card number to add or remove, n/p = next/previous page,\n"
+                 << "a = fill the deck automatically, d = done: " << RESET;
+            latency().finish();
+            string line;
+            if (!getline(cin, line) || line == "d") break;
+
+            if (line == "n") {
+                page = min(page + 1, pages - 1);
+            } else if (line == "p") {
+                page = max(page - 1, 0);
+            } else if (line == "a") {
+                // Keep the player's picks and complete the deck around them
+                if (count < slots) {
+                    fillDeck(powers, picked, slots - count, budget - used);
+                    count = slots;
+                    used = 0;
+                    for (int i = 0; i < n; i++)
+                        if (picked[i]) used += powers[i];
+                }
+            } else {
+                int i = atoi(line.c_str()) - 1;
+                if (i < 0 || i >= n) {
+                    message = "Enter a card number between 1 and " + intToString(n) + ".";
+                } else if (picked[i]) {
+                    picked[i] = 0;
+                    count--;
+                    used -= powers[i];
+                } else if (count == slots) {
+                    message = "The deck is full; remove a card first.";
+                } else {
+                    // The cheapest unpicked cards must still be able to finish the deck
+                    long long need = used + powers[i];
+                    int more = slots - count - 1;
+                    for (int j = n - 1; j >= 0 && more > 0; j--)
+                        if (!picked[j] && j != i) {
+                            need += powers[j];
+                            more--;
+                        }
+                    if (need > budget) {
+                        message = "That card leaves no room to finish the deck within the budget.";
+                    } else {
+                        picked[i] = 1;
+                        count++;
+                        used += powers[i];
+                    }
+                }
+            }
+        }
+
+        if (count < slots) fillDeck(powers, picked, slots - count, budget - used);
+
+        vector<Card> deck;
+        for (int i = 0; i < n; i++)
+            if (picked[i]) deck.push_back(collection[i]);
+        shuffle(deck.begin(), deck.end(), rng);
+        return deck;
+    }
+
+    // Draft: the players take turns picking from the whole pool until each has
+    // half of it. People choose page by page from the cards still free and can
+    // hand the rest of their picks to the computer, which (like both sides of
+    // a network game) takes the strongest card left.
+    void draftCards(vector<Card> &d1, vector<Card> &d2) {
+        const int PAGE = 20;
+        int n = (int)cardPool.size();
+        vector<int> order(n);
+        for (int i = 0; i < n; i++) order[i] = i;
+        sort(order.begin(), order.end(),
+             [this](int a, int b) { return cardPool[a].getPower() > cardPool[b].getPower(); });
+
+        DraftPool draft(cardPool);
+        bool automatic[2] = { networkMode, networkMode || vsComputer };
+        int lastPick[2] = { -1, -1 }, page[2] = { 0, 0 };
+        string message;
+
+        for (int turn = 0; turn < n / 2 * 2; turn++) {
+            int k = turn % 2, pick = -1;
+            const Player &pl = k == 0 ? p1 : p2;
+
+            while (!automatic[k] && pick < 0) {
+                int pages = (draft.left() + PAGE - 1) / PAGE;
+                page[k] = min(page[k], pages - 1);
+
+                clearScreen();
+                cout << CYAN << "======== DRAFT: " << pl.getName() << " (pick " << turn / 2 + 1 << " of "
+                     << n / 2 << ") ========\n" << RESET;
+                if (lastPick[1 - k] >= 0)
+                    cout << (k == 0 ? p2 : p1).getName() << " took " << cardPool[lastPick[1 - k]].describe() << "\n";
+                cout << "\n";
+
+                // Free cards, strongest first, numbered among the free ones
+                int shown = 0, first = page[k] * PAGE;
+                for (int j = 0; j < n && shown < first + PAGE; j++) {
+                    if (draft.isTaken(order[j])) continue;
+                    if (shown >= first)
+                        cout << YELLOW << "  " << (shown + 1) << ". " << RESET << cardPool[order[j]].describe() << "\n";
+                    shown++;
+                }
+                if (!message.empty()) cout << "\n" << MAGENTA << message << RESET << "\n";
+                message.clear();
+
+                cout << YELLOW << "\nPage " << page[k] + 1 << "/" << pages
+                     << ". Card number to pick, n/p = next/previous page,\n"
+                     << "a = make the rest of my picks automatically: " << RESET;
+                latency().finish();
+                string line;
+                if (!getline(cin, line) || line == "a") {
+                    automatic[k] = true;
+                } else if (line == "n") {
+                    page[k]++;
+                } else if (line == "p") {
+                    page[k] = max(page[k] - 1, 0);
+                } else {
+                    int want = atoi(line.c_str());
+                    for (int j = 0; j < n && pick < 0 && want > 0; j++)
+                        if (!draft.isTaken(order[j]) && --want == 0) pick = order[j];
+                    if (pick < 0) message = "Enter a card number between 1 and " + intToString(draft.left()) + ".";
+                }
+            }
+
+            if (pick < 0) pick = draft.best(DraftPool::STRONGEST);
+            draft.take(pick);
+            (k == 0 ? d1 : d2).push_back(cardPool[pick]);
+            lastPick[k] = pick;
+        }
+
+        // Decks are played in a random order, not the order they were drafted
+        shuffle(d1.begin(), d1.end(), rng);
+        shuffle(d2.begin(), d2.end(), rng);
+    }
+
+    // Let the DeckBuilder choose `slots` more of the unpicked cards
+    void fillDeck(const vector<int> &powers, vector<char> &picked, int slots, long long budget) {
+        vector<int> index, free;
+        for (int i = 0; i < (int)powers.size(); i++)
+            if (!picked[i]) {
+                index.push_back(i);
+                free.push_back(powers[i]);
+            }
+        DeckBuilder::Result r = DeckBuilder::build(free, slots, budget);
+        for (size_t k = 0; k < r.chosen.size(); k++) picked[index[r.chosen[k]]] = 1;
+    }
+
+    // Create card pool and distribute to players
+    void generateAndDistributeCards(int totalCards, int distMode) {
+        events.emit(GameEvent(GameEvent::DEAL_START));
+        events.flush();
+
+        generateCardPool(totalCards);
+        gameCards = totalCards;
+        gameDistMode = distMode;
+
+        // Reset players
+        p1 = Player(p1.getName());
+        p2 = Player(p2.getName());
+
+        int half = totalCards / 2;
+        vector<Card> d1, d2;
+
+        // THREE distribution modes
+        if (distMode == 1) {
+            for (int i = 0; i < totalCards; i++)
+                (i % 2 == 0 ? d1 : d2).push_back(cardPool[i]);
+        } else if (distMode == 2) {
+            for (int i = 0; i < totalCards; i++)
+                (i < half ? d1 : d2).push_back(cardPool[i]);
+        } else if (distMode == 4) {
+            // Alternate the pool into two collections, then build a deck from each
+            for (int i = 0; i < totalCards; i++)
+                (i % 2 == 0 ? d1 : d2).push_back(cardPool[i]);
+            d1 = buildDeck(p1, d1);
+            d2 = buildDeck(p2, d2);
+        } else if (distMode == 5) {
+            draftCards(d1, d2);
+        } else if (distMode == 6) {
+            fairSplit(cardPool, totalCards, d1, d2, rng);
+        } else {
+            int p1count = 0;
+            for (int i = 0; i < totalCards; i++) {
+                if ((rng() % 2 == 0 && p1count < half) || (i - p1count) >= half) {
+                    d1.push_back(cardPool[i]);
+                    p1count++;
+                } else {
+                    d2.push_back(cardPool[i]);
+                }
+            }
+        }
+        p1.setDeck(d1);
+        p2.setDeck(d2);
+
+        // Hand mode: both players pick up their cards, computer plans its answers
+        if (handMode) {
+            p1.moveDeckToHand();
+            p2.moveDeckToHand();
+            if (!hiddenHand) planner.build(p2.getHandPowers(), p1.getHandPowers());
+        }
+
+        // Both sides of a network game must arrive at the same hash
+        stateHash = hashMix(14695981039346656037ULL, (long long)totalCards);
+        for (int k = 0; k < 2; k++) {
+            queue<Card> deck = (k == 0 ? p1 : p2).getDeckSnapshot();
+            while (!deck.empty()) {
+                stateHash = hashMix(hashMix(stateHash, deck.front().getName()), deck.front().getPower());
+                deck.pop();
+            }
+        }
+
+        // Small hidden hands are solved exactly instead of searched
+        useSolver = hiddenHand && ExpectimaxSolver::fits(p2.remainingCards());
+        if (useSolver) solver.reset(p2.getHandPowers(), p1.getHandPowers());
+
+        roundNumber = 1;
+        handFocus = 0;
+        writeSnapshot();
+        resetTimeline();
+
+        GameEvent done(GameEvent::DEAL_DONE);
+        done.count[0] = p1.remainingCards();
+        done.count[1] = p2.remainingCards();
+        if (useSolver && events.hasSubscribers()) {
+            done.solved = true;
+            done.value = solver.value(p2.getHandPowers(), p1.getHandPowers());
+        }
+        events.emit(done);
+        events.flush();
+        if (consoleView) waitForEnter();
+    }
+
+    // A player's cards as screen lines, at most `limit` of them: the next
+    // cards of a deck, or a window of the hand around the human's last pick.
+    // Hand cards keep their position in the whole hand as their number, so
+    // any card can still be picked by number.
+    void deckLines(const Player &pl, int limit, vector<string> &lines) {
+        string yellow = YELLOW, reset = RESET;
+        if (hiddenHand && vsComputer && &pl == &p2) {
+            lines.push_back(CYAN + pl.getName() + "'s hand:" + RESET);
+            lines.push_back(WHITE + ("  [" + intToString(pl.remainingCards()) + " hidden cards]") + RESET);
+            lines.push_back("");
+            return;
+        }
+
+        vector<Card> cards;
+        int first = 0;
+        if (handMode) {
+            lines.push_back(CYAN + pl.getName() + "'s hand:" + RESET);
+            int focus = &pl == &p1 ? handFocus : 0;
+            first = max(0, min(focus - limit / 2, pl.handSize() - limit));
+            cards = pl.handSlice(first, limit);
+            if (first > 0) lines.push_back("  ... " + intToString(first) + " weaker cards");
+        } else {
+            lines.push_back(CYAN + pl.getName() + "'s current deck:" + RESET);
+            cards = pl.peekDeck(limit);
+        }
+
+        if (cards.empty()) lines.push_back(WHITE + string("  [No cards]") + RESET);
+        for (size_t i = 0; i < cards.size(); i++)
+            lines.push_back(yellow + "  " + intToString(first + (int)i + 1) + ". " + reset + cards[i].describe());
+        int after = pl.remainingCards() - first - (int)cards.size();
+        if (after > 0) lines.push_back("  ... and " + intToString(after) + " more");
+        lines.push_back("");
+    }
+
+    // Show a player's deck, up to a screenful or two of it
+    void printDeckList(const Player &pl) {
+        vector<string> lines;
+        deckLines(pl, 100, lines);
+        for (size_t i = 0; i < lines.size(); i++) cout << lines[i] << "\n";
+    }
+
+    // Compare card powers
+    int compareCards(const Card &c1, const Card &c2) {
+        if (c1.getPower() > c2.getPower()) return 1;
+        if (c2.getPower() > c1.getPower()) return -1;
+        return 0;
+    }
+
+    // Ask which card of the hand to play (1-based on screen)
+    int askHandChoice(const Player &pl) {
+        int choice = -1;
+        do {
+            cout << YELLOW << pl.getName() << ", choose a card (1-"
+                 << pl.remainingCards() << "): " << RESET;
+            latency().finish();
+            cin >> choice;
+
+            if (cin.fail()) {
+                cin.clear();
+                choice = -1;
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        } while (choice < 1 || choice > pl.remainingCards());
+
+        return choice - 1;
+    }
+
+    // Auto-play picks the human's card at random
+    int autoHandChoice(const Player &pl) {
+        return (int)(rng() % (unsigned)pl.remainingCards());
+    }
+
+    // Play one round of the game
+    void playRound() {
+        if (!p1.hasCards() || !p2.hasCards()) {
+            cout << RED << "Cannot play round: one deck empty.\n" << RESET;
+            waitForEnter();
+            return;
+        }
+
+        int round = roundNumber;
+        events.emit(GameEvent(GameEvent::ROUND_START, round));
+
+        Card c1, c2;
+        int p1Choice = -1;    // Hand position the human played, for the journal
+        if (hiddenHand) {
+            // Computer commits first, then the human picks blind
+            events.emit(GameEvent(GameEvent::AI_THINKING, round, 1));
+            events.flush();
+            int power = useSolver ? solver.choose(p2.getHandPowers(), p1.getHandPowers())
+                                  : mcts.choose(p2.getHandCounts(), p1.getHandCounts());
+            c2 = p2.playFromHandByPower(power);
+            events.emit(GameEvent(GameEvent::CARD_HIDDEN, round, 1));
+            events.flush();
+            p1Choice = autoPlaying ? autoHandChoice(p1) : askHandChoice(p1);
+            c1 = p1.playFromHand(p1Choice);
+            handFocus = p1Choice;
+        } else if (handMode) {
+            // Human picks from the hand, computer answers from its plan
+            events.flush();
+            p1Choice = autoPlaying ? autoHandChoice(p1) : askHandChoice(p1);
+            c1 = p1.playFromHand(p1Choice);
+            handFocus = p1Choice;
+            c2 = p2.playFromHandByPower(planner.respond(c1.getPower()));
+        } else {
+            // The table already shows the decks, so the menu choice was the input
+            c1 = p1.drawCard();
+            c2 = p2.drawCard();
+        }
+        journalRound(p1Choice, c2.getPower());
+
+        GameEvent played(GameEvent::CARD_PLAYED, round, 0);
+        played.card = c1;
+        events.emit(played);
+        played.player = 1;
+        played.card = c2;
+        events.emit(played);
+
+        int res = resolveRound(c1, c2);
+        recordTurn();
+
+        GameEvent result(GameEvent::ROUND_RESULT, round, res == 1 ? 0 : (res == -1 ? 1 : -1));
+        result.count[0] = p1.remainingCards();
+        result.count[1] = p2.remainingCards();
+        events.emit(result);
+        events.flush();
+    }
+
+    // Hand out the cards of a round and advance the round counter
+    int resolveRound(const Card &c1, const Card &c2) {
+        stateHash = hashMix(hashMix(stateHash, c1.getPower()), c2.getPower());
+
+        int res = compareCards(c1, c2);
+        if (res == 1) {
+            p1.addWinCards(c1, c2);
+        } else if (res == -1) {
+            p2.addWinCards(c1, c2);
+        } else {
+            p1.keepOwnCard(c1);
+            p2.keepOwnCard(c2);
+        }
+
+        roundNumber++;
+        return res;
+    }
+
+    // Undo works on decks and won piles, so not in hand modes; a network
+    // game cannot go back on its own
+    bool canUndo() const { return !handMode && !networkMode && !tableMode; }
+
+    void recordTurn() {
+        if (!canUndo()) return;
+        Turn t;
+        t.a = p1.saveState();
+        t.b = p2.saveState();
+        t.round = roundNumber;
+        t.hash = stateHash;
+        timeline.push_back(t);
+    }
+
+    void resetTimeline() {
+        timeline.clear();
+        recordTurn();
+    }
+
+    // Step back any number of rounds in O(1) per player
+    void undoRounds() {
+        int most = (int)timeline.size() - 1;
+        int steps = askNumber("Rounds to undo (1-" + intToString(most) + ", 0 = cancel): ", 0, most);
+        if (steps == 0) return;
+
+        timeline.resize(timeline.size() - steps);
+        const Turn &t = timeline.back();
+        p1.restoreState(t.a);
+        p2.restoreState(t.b);
+        roundNumber = t.round;
+        stateHash = t.hash;
+        lastRound.clear();
+        lastRound.push_back(MAGENTA + ("Went back " + intToString(steps) + " round(s).") + RESET);
+
+        // The journal holds the undone rounds; start a fresh save from here
+        writeSnapshot();
+    }
+
+    // Show current scores
+    void showScores() {
+        clearScreen();
+        cout << CYAN << "======== CURRENT SCORE ========\n" << RESET;
+        cout << p1.getName() << ": " << p1.getScore() << "\n";
+        cout << p2.getName() << ": " << p2.getScore() << "\n";
+        waitForEnter();
+    }
+
+    // Show remaining cards count
+    void showRemainingCards() {
+        clearScreen();
+        cout << CYAN << "==== REMAINING CARDS ====\n" << RESET;
+        cout << p1.getName() << ": " << p1.remainingCards() << "\n";
+        cout << p2.getName() << ": " << p2.remainingCards() << "\n";
+        waitForEnter();
+    }
+
+    // View player's deck menu
+    void viewDeckMenu() {
+        clearScreen();
+        if (vsComputer && (!handMode || hiddenHand)) {
+            printDeckList(p1);
+        } else {
+            int choice;
+            cout << CYAN << "Whose deck do you want to view?\n" << RESET;
+            cout << "1. " << p1.getName() << "\n";
+            cout << "2. " << p2.getName() << "\n";
+            cout << "Enter choice: ";
+            latency().finish();
+            cin >> choice;
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            latency().start("View Deck: pick player");
+
+            if (choice == 1) printDeckList(p1);
+            else printDeckList(p2);
+        }
+        waitForEnter();
+    }
+
+    // Show the final winner
+    void showFinalResult() {
+        int s1 = p1.getScore();
+        int s2 = p2.getScore();
+
+        // A finished game has nothing left to resume
+        if (canSave()) deleteSave();
+        timeline.clear();
+        history.record(p1.getName(), p2.getName(), s1, s2, gameCards, gameDistMode, MatchHistory::CONSOLE);
+        history.flush();
+
+        // Rate the finished match
+        string k1 = ratingKey(p1.getName()), k2 = ratingKey(p2.getName());
+        ratings.recordResult(k1, k2, s1 > s2 ? 1.0 : (s2 > s1 ? 0.0 : 0.5));
+        ratings.flush();
+
+        GameEvent over(GameEvent::GAME_OVER, roundNumber, s1 > s2 ? 0 : (s2 > s1 ? 1 : -1));
+        over.count[0] = s1;
+        over.count[1] = s2;
+        events.emit(over);
+        events.flush();
+        if (consoleView) waitForEnter();
+    }
+
+    // Play rounds back to back without prompts. The console view is
+    // detached while they run, so nothing is rendered; a single progress
+    // line is rewritten a few times a second. The journal is skipped and one
+    // snapshot is written at the end instead.
+    void autoPlayRounds() {
+        int limit = askNumber("Rounds to play (0 = to the end): ", 0, 100000000);
+
+        detachConsoleView();
+        autoPlaying = true;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        chrono::steady_clock::time_point shown = start;
+        int played = 0;
+        while (p1.hasCards() && p2.hasCards() && (limit == 0 || played < limit)) {
+            playRound();
+            played++;
+
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if (now - shown >= chrono::milliseconds(100)) {
+                shown = now;
+                cout << "\r" << CYAN << "Auto-playing: round " << (roundNumber - 1) << ", cards left "
+                     << p1.remainingCards() << " / " << p2.remainingCards() << RESET << "   " << flush;
+            }
+        }
+        autoPlaying = false;
+        attachConsoleView();
+        lastRound.clear();
+        writeSnapshot();
+
+        long long ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - start).count();
+        clearScreen();
+        cout << GREEN << "Played " << played << " rounds in " << ms << " ms.\n\n" << RESET;
+        cout << p1.getName() << ": score " << p1.getScore() << ", " << p1.remainingCards() << " cards left\n";
+        cout << p2.getName() << ": score " << p2.getScore() << ", " << p2.remainingCards() << " cards left\n";
+        waitForEnter();
+    }
+
+    // The game table: both players' cards, the last round and the menu.
+    // It stays on screen between rounds, so a round only redraws the lines
+    // it changed.
+    void drawTable(bool withMenu = true) {
+        vector<string> lines;
+        lines.push_back(CYAN + ("========== ROUND " + intToString(roundNumber) + " ==========") + RESET);
+        lines.push_back("");
+        int shown = handMode ? 9 : 3;     // A hand shows enough to pick from
+        deckLines(p1, shown, lines);
+        deckLines(p2, shown, lines);
+        for (size_t i = 0; i < lastRound.size(); i++) lines.push_back(lastRound[i]);
+        lines.push_back("Score: " + p1.getName() + " " + intToString(p1.getScore()) + " | "
+                        + p2.getName() + " " + intToString(p2.getScore()));
+        lines.push_back("");
+
+        // Every line carries its own color, since any one may be redrawn alone
+        if (withMenu) {
+            vector<string> menu;
+            menu.push_back("======== GAME MENU ========");
+            menu.push_back("1. Play Next Round");
+            menu.push_back("2. View Scores");
+            menu.push_back("3. View Remaining Cards");
+            menu.push_back("4. View Deck");
+            if (canSave()) menu.push_back("5. Save Game");
+            if (!networkMode) menu.push_back("6. Auto-play Rounds");
+            if (canUndo() && timeline.size() > 1) menu.push_back("7. Undo Rounds");
+            menu.push_back("0. End Game Now");
+            menu.push_back("===========================");
+            menu.push_back("Enter choice: ");
+            for (size_t i = 0; i < menu.size(); i++) lines.push_back(YELLOW + menu[i] + RESET);
+        }
+        screen().present(lines);
+    }
+
+    // In-game menu loop
+    void gameLoop() {
+        while (true) {
+            if (!p1.hasCards() || !p2.hasCards()) {
+                showFinalResult();
+                break;
+            }
+
+            drawTable();
+
+            int ch;
+            cin >> ch;
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+            static const char *actions[] = { "End Game", "Play Next Round", "View Scores",
+                                             "View Remaining Cards", "View Deck", "Save Game",
+                                             "Auto-play Rounds", "Undo Rounds" };
+            latency().start(ch >= 0 && ch <= 7 ? actions[ch] : "Other");
+
+            // Playing or ending is agreed with the peer first
+            if (networkMode && (ch == 1 || ch == 0)) {
+                int agreed = exchangeInput(ch == 1 ? 'R' : 'E');
+                if (agreed < 0) {
+                    waitForEnter();
+                    break;
+                }
+                ch = agreed;
+            }
+
+            if (ch == 1) {
+                playRound();
+                // The last round stays on screen until the final result replaces it
+                if (consoleView && (!p1.hasCards() || !p2.hasCards())) waitForEnter();
+            }
+            else if (ch == 2) showScores();
+            else if (ch == 3) showRemainingCards();
+            else if (ch == 4) viewDeckMenu();
+            else if (ch == 5 && canSave()) {
+                writeSnapshot();
+                cout << GREEN << "Game saved. Resume it from the start menu next time.\n" << RESET;
+                waitForEnter();
+            }
+            else if (ch == 6 && !networkMode) autoPlayRounds();
+            else if (ch == 7 && canUndo() && timeline.size() > 1) undoRounds();
+            else if (ch == 0) {
+                showFinalResult();
+                break;
+            }
+        }
+    }
+
+    // Save files: a snapshot, rewritten through a temp file and rename, plus a
+    // journal of the rounds played since. Autosave only appends one 9-byte
+    // record per round, so it costs the same on any deck size; resuming
+    // replays the journal on top of the snapshot. Journal records carry the
+    // snapshot generation, and a torn last record is ignored.
+    static const char *savePath() { return "cardbattle.sav"; }
+    static const char *journalPath() { return "cardbattle.sav.log"; }
+
+    bool canSave() const { return !networkMode && !tableMode; }
+
+    // Newest generation in the save files. Counting on from it keeps a new
+    // snapshot from sharing a number with a journal left by an earlier run.
+    static uint32_t generationOnDisk() {
+        uint32_t gen = 0;
+        char head[12];
+        ifstream snap(savePath(), ios::binary);
+        if (snap.read(head, 12)) {
+            ByteReader r(string(head, 12));
+            r.u32();   // Magic
+            r.u32();   // Version
+            gen = r.u32();
+        }
+        ifstream log(journalPath(), ios::binary);
+        if (log.read(head, 4)) gen = max(gen, ByteReader(string(head, 4)).u32());
+        return gen;
+    }
+
+    void writeSnapshot() {
+        if (!canSave()) return;
+        saveGeneration++;
+
+        ByteWriter w;
+        w.u32(0x56534243); // "CBSV"
+        w.u32(2);          // Format version
+        w.u32(saveGeneration);
+        w.u8((vsComputer ? 1 : 0) | (handMode ? 2 : 0) | (hiddenHand ? 4 : 0));
+        w.u32((uint32_t)roundNumber);
+        w.u32((uint32_t)gameCards);
+        w.u8(gameDistMode);
+        w.u32((uint32_t)mcts.getBudgetMs());
+        w.u64(stateHash);
+        stringstream rs;
+        rs << rng;
+        w.str(rs.str());
+
+        for (int k = 0; k < 2; k++) {
+            const Player &pl = k == 0 ? p1 : p2;
+            w.str(pl.getName());
+
+            queue<Card> deck = pl.getDeckSnapshot();
+            w.u32((uint32_t)deck.size());
+            while (!deck.empty()) {
+                w.card(deck.front());
+                deck.pop();
+            }
+            vector<Card> hand = pl.getHandSnapshot();
+            w.u32((uint32_t)hand.size());
+            for (size_t i = 0; i < hand.size(); i++) w.card(hand[i]);
+            vector<Card> won = pl.getDiscardSnapshot();
+            w.u32((uint32_t)won.size());
+            for (size_t i = 0; i < won.size(); i++) w.card(won[i]);
+        }
+        w.u64(hashMix(14695981039346656037ULL, w.data()));
+
+        // Snapshot first: a journal of the old generation is then ignored
+        ByteWriter header;
+        header.u32(saveGeneration);
+        writeFileAtomically(savePath(), w.data());
+        writeFileAtomically(journalPath(), header.data());
+    }
+
+    // Autosave: one record per round, type + human's hand position + p2 power
+    void journalRound(int p1Choice, int p2Power) {
+        if (!canSave() || autoPlaying) return;
+        ByteWriter w;
+        w.u8(handMode ? 'H' : 'R');
+        w.u32((uint32_t)p1Choice);
+        w.u32((uint32_t)p2Power);
+        FILE *f = fopen(journalPath(), "ab");
+        if (!f) return;
+        fwrite(w.data().data(), 1, w.data().size(), f);
+        fclose(f);
+    }
+
+    void deleteSave() {
+        remove(savePath());
+        remove(journalPath());
+    }
+
+    bool hasSave() const {
+        ifstream in(savePath(), ios::binary);
+        return (bool)in;
+    }
+
+    // Load the snapshot and replay the journal; false if there is no valid save
+    bool loadSave() {
+        string data;
+        if (!readWholeFile(savePath(), data) || data.size() < 8) return false;
+        string body = data.substr(0, data.size() - 8);
+        string checksum = data.substr(data.size() - 8);
+        ByteReader tail(checksum);
+        if (tail.u64() != hashMix(14695981039346656037ULL, body)) return false;
+
+        ByteReader r(body);
+        if (r.u32() != 0x56534243 || r.u32() != 2) return false;
+        saveGeneration = r.u32();
+        int flags = r.u8();
+        vsComputer = (flags & 1) != 0;
+        handMode = (flags & 2) != 0;
+        hiddenHand = (flags & 4) != 0;
+        tableMode = false;
+        networkMode = false;
+        roundNumber = (int)r.u32();
+        gameCards = (int)r.u32();
+        gameDistMode = r.u8();
+        mcts.setBudgetMs((int)r.u32());
+        stateHash = r.u64();
+        stringstream rs(r.str());
+        rs >> rng;
+
+        for (int k = 0; k < 2; k++) {
+            Player &pl = k == 0 ? p1 : p2;
+            pl = Player(r.str());
+            // Installed in one go, so the first draw does not reverse it
+            uint32_t n = r.u32();
+            vector<Card> deck;
+            for (uint32_t i = 0; i < n && r.ok(); i++) deck.push_back(r.card());
+            pl.setDeck(deck);
+            n = r.u32();
+            for (uint32_t i = 0; i < n && r.ok(); i++) {
+                Card c = r.card();
+                if (r.ok()) pl.addCardToHand(c);
+            }
+            n = r.u32();
+            for (uint32_t i = 0; i < n && r.ok(); i++) pl.keepOwnCard(r.card());
+        }
+        if (!r.ok()) return false;
+
+        // Replay complete journal records of this generation
+        string journal;
+        if (readWholeFile(journalPath(), journal) && journal.size() >= 4) {
+            ByteReader j(journal);
+            if (j.u32() == saveGeneration) {
+                // Stop at the first record that does not fit the game as it stands
+                while (journal.size() - j.offset() >= 9 && p1.hasCards() && p2.hasCards()) {
+                    int type = j.u8();
+                    uint32_t choice = j.u32();
+                    int power = (int)j.u32();
+                    if (type != (handMode ? 'H' : 'R')) break;
+                    if (handMode) {
+                        if (choice >= (uint32_t)p1.handSize() || !p2.holdsPower(power)) break;
+                        Card c1 = p1.playFromHand((int)choice);
+                        resolveRound(c1, p2.playFromHandByPower(power));
+                    } else {
+                        Card c1 = p1.drawCard();
+                        resolveRound(c1, p2.drawCard());
+                    }
+                }
+            }
+        }
+
+        // The computer re-plans from the hands as they are now
+        if (handMode && !hiddenHand) planner.build(p2.getHandPowers(), p1.getHandPowers());
+        useSolver = hiddenHand && ExpectimaxSolver::fits(p2.remainingCards());
+        if (useSolver) solver.reset(p2.getHandPowers(), p1.getHandPowers());
+
+        writeSnapshot();
+        resetTimeline();
+        return true;
+    }
+
+    // Start menu: continue the saved game
+    void resumeSavedGame() {
+        clearScreen();
+        if (!loadSave()) {
+            cout << RED << "No saved game could be loaded.\n" << RESET;
+            waitForEnter();
+            return;
+        }
+        cout << GREEN << "Resumed " << p1.getName() << " vs " << p2.getName()
+             << " at round " << roundNumber << ".\n" << RESET;
+        waitForEnter();
+        gameLoop();
+    }
+
+    // Send our input and the state hash, wait for the peer's.
+    // Returns 1 to play the round, 0 to end the game, -1 on a broken link.
+    int exchangeInput(char input) {
+        unsigned char msg[5], reply[5];
+        uint32_t h = (uint32_t)stateHash;
+        msg[0] = (unsigned char)input;
+        memcpy(msg + 1, &h, 4);
+
+        cout << CYAN << "Waiting for opponent...\n" << RESET;
+        if (!peer.sendAll(msg, 5) || !peer.recvAll(reply, 5)) {
+            cout << RED << "Connection to opponent lost.\n" << RESET;
+            return -1;
+        }
+        if (memcmp(msg + 1, reply + 1, 4) != 0) {
+            cout << RED << "Games out of sync (state hash mismatch).\n" << RESET;
+            return -1;
+        }
+        return (input == 'E' || reply[0] == 'E') ? 0 : 1;
+    }
+
+    // Host or join a network game; both sides end up with the same seed,
+    // settings and names. Returns false if no game was set up.
+    bool setupNetworkMatch(int &totalCards, int &distMode) {
+        clearScreen();
+        int role = askNumber("1. Host a game\n2. Join a game\nEnter choice: ", 1, 2);
+        int port = askNumber("Port on this machine (1024-65535): ", 1024, 65535);
+
+        string name;
+        cout << CYAN << "Enter your name: " << RESET;
+        getline(cin, name);
+        if (name.empty()) name = role == 1 ? "Player1" : "Player2";
+
+        string other;
+        uint32_t seed, settings[16];    // Cards, mode, rarity weights and ranges, deck size and budget
+        if (role == 1) {
+            askGameSettings(totalCards, distMode);
+            clearScreen();
+            cout << CYAN << "Waiting for an opponent on port " << port << "...\n" << RESET;
+            if (!peer.host(port)) {
+                cout << RED << "Could not host on port " << port << "\n" << RESET;
+                waitForEnter();
+                return false;
+            }
+            seed = (uint32_t)rand();
+            settings[0] = (uint32_t)totalCards;
+            settings[1] = (uint32_t)distMode;
+            for (int i = 0; i < 4; i++) {
+                settings[2 + i] = (uint32_t)dealRarity.weight[i];
+                settings[6 + i] = (uint32_t)dealRarity.low[i];
+                settings[10 + i] = (uint32_t)dealRarity.high[i];
+            }
+            settings[14] = (uint32_t)(distMode == 4 ? buildSlots : 0);
+            settings[15] = (uint32_t)(distMode == 4 ? buildBudget : 0);
+            if (!peer.sendAll(&seed, 4) || !peer.sendAll(settings, sizeof(settings)) ||
+                !peer.sendString(name) || !peer.recvString(other)) {
+                peer.disconnect();
+                return false;
+            }
+            p1.setName(name);
+            p2.setName(other);
+        } else {
+            if (!peer.join(port) || !peer.recvAll(&seed, 4) || !peer.recvAll(settings, sizeof(settings)) ||
+                !peer.recvString(other) || !peer.sendString(name)) {
+                cout << RED << "Could not join a game on port " << port << "\n" << RESET;
+                peer.disconnect();
+                waitForEnter();
+                return false;
+            }
+            totalCards = (int)settings[0];
+            distMode = (int)settings[1];
+            for (int i = 0; i < 4; i++) {
+                dealRarity.weight[i] = (int)settings[2 + i];
+                dealRarity.low[i] = (int)settings[6 + i];
+                dealRarity.high[i] = (int)settings[10 + i];
+            }
+            buildSlots = (int)settings[14];
+            buildBudget = (int)settings[15];
+            // The host's askGameSettings only sends an even total in range
+            bool cardsOk = totalCards >= 4 && totalCards <= MAX_CARDS && totalCards % 2 == 0;
+            if (!cardsOk || !dealRarity.valid() || distMode < 1 || distMode > 6 ||
+                (distMode == 4 && (buildSlots < 1 || buildSlots > totalCards / 2 || buildBudget < 1))) {
+                cout << RED << "The host sent invalid game settings.\n" << RESET;
+                peer.disconnect();
+                waitForEnter();
+                return false;
+            }
+            p1.setName(other);
+            p2.setName(name);
+        }
+
+        rng.seed(seed);
+        return true;
+    }
+
+    // Ask a whole number within limits, re-asking on bad input
+    int askNumber(const string &prompt, int lo, int hi) {
+        int value = lo - 1;
+        do {
+            cout << YELLOW << prompt << RESET;
+            latency().finish();
+            cin >> value;
+
+            if (cin.fail()) {
+                cin.clear();
+                value = lo - 1;
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        } while (value < lo || value > hi);
+        return value;
+    }
+
+    // Names, deck size and dealing for the multiplayer table
+    void setupTable() {
+        clearScreen();
+        int count = askNumber("Number of players (3-10000): ", 3, 10000);
+
+        vector<string> names;
+        for (int i = 0; i < count; i++) {
+            string name;
+            if (count <= 8) {
+                cout << CYAN << "Enter Player " << (i + 1) << " name: " << RESET;
+                getline(cin, name);
+            }
+            if (name.empty()) name = "Player" + intToString(i + 1);
+            names.push_back(name);
+        }
+        table.setPlayers(names);
+
+        // The whole pool is generated and dealt at once, so the total is capped
+        int most = min(10000, Table::MAX_CARDS / count);
+        int perPlayer = askNumber("Cards per player (2-" + intToString(most) + "): ", 2, most);
+        cout << CYAN << "\nChoose card distribution style:\n" << RESET;
+        const int dealers[] = { 0, 1, 2, 3, 5 };
+        int distMode = dealers[askNumber("1. Round robin\n2. Consecutive blocks\n3. Random equal\n4. Draft\nEnter choice: ", 1, 4)];
+
+        clearScreen();
+        cout << CYAN << "Generating cards...\n" << RESET;
+        generateCardPool(perPlayer * count);
+        table.deal(cardPool, distMode, rng);
+
+        cout << GREEN << "Decks are ready! " << count << " players, "
+             << perPlayer << " cards each.\n" << RESET;
+        waitForEnter();
+    }
+
+    // Show table standings (top 20 for big tables)
+    void showTableStandings() {
+        clearScreen();
+        cout << CYAN << "======== STANDINGS ========\n" << RESET;
+        vector<int> order = table.standings();
+        int shown = min((int)order.size(), 20);
+        for (int i = 0; i < shown; i++) {
+            const Player &pl = table.getPlayer(order[i]);
+            cout << (i + 1) << ". " << pl.getName() << "  score: " << pl.getScore()
+                 << "  cards left: " << pl.remainingCards() << "\n";
+        }
+        if (shown < (int)order.size())
+            cout << "... and " << (order.size() - shown) << " more\n";
+    }
+
+    // Play one table round and report it
+    void playTableRound() {
+        clearScreen();
+        cout << CYAN << "========== ROUND " << table.getRoundNumber() << " ==========\n\n" << RESET;
+
+        Table::RoundResult r = table.playRound();
+        cout << r.cardsPlayed << " cards played, top power " << r.topPower << ".\n";
+        if (r.winner >= 0) {
+            cout << GREEN << table.getPlayer(r.winner).getName() << " wins this round!\n" << RESET;
+        } else {
+            cout << MAGENTA << "Draw between " << r.tied.size()
+                 << " players. They keep their cards and share the rest.\n" << RESET;
+        }
+        cout << CYAN << "\nPlayers still holding cards: " << table.activeCount() << "\n" << RESET;
+        waitForEnter();
+    }
+
+    // In-game menu for the multiplayer table
+    void tableLoop() {
+        while (!table.isOver()) {
+            clearScreen();
+            cout << YELLOW << "======== TABLE MENU ========\n";
+            cout << "1. Play Next Round\n";
+            cout << "2. View Standings\n";
+            cout << "0. End Game Now\n";
+            cout << "============================\n" << RESET;
+            int ch = askNumber("Enter choice: ", 0, 2);
+
+            if (ch == 1) playTableRound();
+            else if (ch == 2) {
+                showTableStandings();
+                waitForEnter();
+            } else break;
+        }
+
+        showTableStandings();
+        vector<int> order = table.standings();
+        const Player &best = table.getPlayer(order[0]);
+        if (table.getPlayer(order[1]).getScore() == best.getScore())
+            cout << MAGENTA << "\nMATCH DRAW \n" << RESET;
+        else
+            cout << GREEN << "\nWINNER: " << best.getName() << " \n" << RESET;
+        waitForEnter();
+    }
+
+    // Run a full game
+    void runSingleGame() {
+        chooseMode();
+        if (tableMode) {
+            dealRarity = raritySettings;
+            setupTable();
+            tableLoop();
+            return;
+        }
+
+        int totalCards, distMode;
+        rng.seed((unsigned)rand());
+        dealRarity = raritySettings;
+        if (networkMode) {
+            if (!setupNetworkMatch(totalCards, distMode)) return;
+        } else {
+            setupPlayers();
+            askGameSettings(totalCards, distMode);
+        }
+
+        generateAndDistributeCards(totalCards, distMode);
+        gameLoop();
+        peer.disconnect();
+    }
+
+    // Set up and run a whole tournament without manual play
+    void runTournament() {
+        clearScreen();
+        cout << CYAN << "Tournament format:\n" << RESET;
+        int format = askNumber("1. Single elimination\n2. Swiss\n3. Round robin\nEnter choice: ", 1, 3);
+
+        vector<string> names;
+        cout << CYAN << "Player names file (one per line, blank for numbered players): " << RESET;
+        string path;
+        getline(cin, path);
+        if (!path.empty()) {
+            ifstream in(path.c_str());
+            string line;
+            while (getline(in, line))
+                if (!line.empty()) names.push_back(line);
+            if (names.size() < 2) {
+                cout << RED << "Could not read at least 2 names from " << path << "\n" << RESET;
+                waitForEnter();
+                return;
+            }
+        } else {
+            int count = askNumber("Number of players (2-100000): ", 2, 100000);
+            for (int i = 0; i < count; i++) names.push_back("Player" + intToString(i + 1));
+        }
+
+        int cards = askNumber("Cards per match (even, 4-1000): ", 4, 1000);
+        cards -= cards % 2;
+        const int dealers[] = { 0, 1, 2, 3, 6 };
+        int distMode = dealers[askNumber("Distribution (1. Alternate  2. Halves  3. Random  4. Fair): ", 1, 4)];
+        int rounds = 0;
+        if (format == Tournament::SWISS)
+            rounds = askNumber("Swiss rounds (0 = automatic): ", 0, 1000);
+
+        clearScreen();
+        cout << CYAN << "Running tournament for " << names.size() << " players on "
+             << workerPool().size() << " threads...\n" << RESET;
+
+        Tournament t(workerPool(), names, cards, distMode, (unsigned)rand(), &ratings, &history);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        t.run((Tournament::Format)format, rounds);
+        ratings.flush();
+        history.flush();
+        long long ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - start).count();
+
+        cout << GREEN << t.getMatchesPlayed() << " matches played in " << ms << " ms\n\n" << RESET;
+        cout << CYAN << "======== STANDINGS ========\n" << RESET;
+        vector<int> order = t.standings();
+        int shown = min((int)order.size(), 20);
+        for (int i = 0; i < shown; i++) {
+            cout << (i + 1) << ". " << t.getName(order[i]) << "  points: " << t.getPoints(order[i])
+                 << "  cards won: " << t.getCardScore(order[i]) << "\n";
+        }
+        if (shown < (int)order.size())
+            cout << "... and " << (order.size() - shown) << " more\n";
+        cout << GREEN << "\nCHAMPION: " << t.getName(t.getChampion()) << " \n" << RESET;
+        waitForEnter();
+    }
+
+    // Many players arrive at once; the queue pairs them by rating and
+    // every pair plays a rated headless match on the thread pool
+    void runMatchmaking() {
+        clearScreen();
+        int count = askNumber("Players arriving (2-1000000): ", 2, 1000000);
+        int producers = askNumber("Arrival threads (1-64): ", 1, 64);
+        int cards = askNumber("Cards per match (even, 4-1000): ", 4, 1000);
+        cards -= cards % 2;
+
+        clearScreen();
+        cout << CYAN << "Matchmaking " << count << " players...\n" << RESET;
+
+        MatchmakingQueue mmq;
+        atomic<long long> played(0);
+        atomic<long long> ratingGap(0);
+        atomic<int> arrived(0);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        vector<thread> arrivals;
+        for (int t = 0; t < producers; t++) {
+            arrivals.push_back(thread([&, t] {
+                for (int i = t; i < count; i += producers) {
+                    string name = "Player" + intToString(i + 1);
+                    double r = ratings.get(name).glicko;
+                    while (!mmq.enqueue(name, r)) this_thread::yield();
+                    arrived++;
+                }
+            }));
+        }
+
+        // Matcher loop; an odd player out is left waiting at the end
+        vector<pair<MatchmakingQueue::Ticket, MatchmakingQueue::Ticket> > matches;
+        unsigned matchSeed = (unsigned)rand();
+        while (true) {
+            bool allArrived = arrived.load() == count;
+            matches.clear();
+            mmq.poll(matches);
+            for (size_t i = 0; i < matches.size(); i++) {
+                string a = matches[i].first.name, b = matches[i].second.name;
+                ratingGap += (long long)fabs(matches[i].first.rating - matches[i].second.rating);
+                unsigned seed = matchSeed + 7919u * (unsigned)(played++);
+                workerPool().submit([this, a, b, cards, seed] {
+                    MatchResult r = playHeadlessMatch(a, b, cards, 3, seed);
+                    ratings.recordResult(a, b, r.winner == 0 ? 1.0 : (r.winner == 1 ? 0.0 : 0.5));
+                    history.record(a, b, r.scoreA, r.scoreB, cards, 3, MatchHistory::MATCHMAKING);
+                });
+            }
+            if (allArrived && matches.empty() && mmq.waitingCount() <= 1) break;
+            if (matches.empty()) this_thread::sleep_for(chrono::milliseconds(1));
+        }
+
+        for (size_t t = 0; t < arrivals.size(); t++) arrivals[t].join();
+        workerPool().waitIdle();
+        ratings.flush();
+        history.flush();
+
+        long long ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - start).count();
+        cout << GREEN << played.load() << " matches hosted in " << ms << " ms\n" << RESET;
+        if (played.load() > 0)
+            cout << "Average rating gap: " << ratingGap.load() / played.load() << "\n";
+        cout << "Players left waiting: " << mmq.waitingCount() << "\n";
+        waitForEnter();
+    }
+
+#ifdef __linux__
+    // Host sessions over sockets; endpoints are "tcp:PORT" or "unix:PATH"
+    int runServer(const vector<string> &endpoints) {
+        GameServer server(workerPool(), ratings, history);
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            const string &e = endpoints[i];
+            bool ok = false;
+            if (e.compare(0, 4, "tcp:") == 0) ok = server.listenTcp(atoi(e.c_str() + 4));
+            else if (e.compare(0, 5, "unix:") == 0) ok = server.listenUnix(e.substr(5));
+            if (!ok) {
+                cout << RED << "Cannot listen on " << e << "\n" << RESET;
+                return 1;
+            }
+            cout << GREEN << "Listening on " << e << "\n" << RESET;
+        }
+
+        server.run();
+        ratings.flush();
+        history.flush();
+        cout << GREEN << "\nServer stopped.\n" << RESET;
+        return 0;
+    }
+#endif
+
+    // "YYYY-MM-DD" to local midnight in Unix seconds, -1 if malformed
+    long long parseDate(const string &text) {
+        tm t;
+        memset(&t, 0, sizeof(t));
+        if (sscanf(text.c_str(), "%d-%d-%d", &t.tm_year, &t.tm_mon, &t.tm_mday) != 3) return -1;
+        t.tm_year -= 1900;
+        t.tm_mon -= 1;
+        t.tm_isdst = -1;
+        return (long long)mktime(&t);
+    }
+
+    void printMatchRecord(const MatchRecord &r) {
+        static const char *sources[] = { "console", "tournament", "matchmaking", "server" };
+        char when[32];
+        time_t t = (time_t)r.time;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&t));
+        cout << "  " << when << "  " << r.playerA << " " << r.scoreA << " - " << r.scoreB
+             << " " << r.playerB << "  (" << r.totalCards << " cards, mode " << r.distMode
+             << ", " << sources[r.source & 3] << ")\n";
+    }
+
+    // Weights and power ranges of the rarities for new games
+    void editRaritySettings() {
+        while (true) {
+            clearScreen();
+            cout << CYAN << "======== CARD RARITY SETTINGS ========\n" << RESET;
+            int total = 0;
+            for (int i = 0; i < 4; i++) total += raritySettings.weight[i];
+            for (int i = 0; i < 4; i++) {
+                Card sample("", 0, RARITY_NAMES[i]);
+                char row[96];
+                snprintf(row, sizeof(row), "%d. %-10s weight %5d (%5.1f%%)  power %4d - %4d\n", i + 1,
+                         RARITY_NAMES[i], raritySettings.weight[i], 100.0 * raritySettings.weight[i] / total,
+                         raritySettings.low[i], raritySettings.high[i]);
+                cout << sample.rarityColor() << row << RESET;
+            }
+            cout << "\n";
+            int ch = askNumber("Rarity to change (1-4), 5 = restore defaults, 0 = back: ", 0, 5);
+            if (ch == 0) return;
+            if (ch == 5) {
+                raritySettings = RaritySettings();
+                continue;
+            }
+
+            RaritySettings next = raritySettings;
+            int r = ch - 1;
+            next.weight[r] = askNumber("Weight (0-1000000): ", 0, 1000000);
+            next.low[r] = askNumber("Lowest power (1-1000): ", 1, 1000);
+            next.high[r] = askNumber("Highest power (" + intToString(next.low[r]) + "-1000): ", next.low[r], 1000);
+            if (next.valid()) {
+                raritySettings = next;
+            } else {
+                cout << RED << "At least one rarity needs a weight above 0.\n" << RESET;
+                waitForEnter();
+            }
+        }
+    }
+
+    // Query the match history
+    void showHistoryMenu() {
+        while (true) {
+            clearScreen();
+            cout << CYAN << "======== MATCH HISTORY ========\n" << RESET;
+            cout << history.size() << " matches recorded\n\n";
+            cout << YELLOW << "1. Player statistics\n2. Matches between dates\n"
+                 << "3. Matches per distribution mode\n4. Compact history\n0. Back\n" << RESET;
+            int ch = askNumber("Enter choice: ", 0, 4);
+            if (ch == 0) return;
+
+            clearScreen();
+            if (ch == 1) {
+                cout << CYAN << "Player name: " << RESET;
+                string name;
+                getline(cin, name);
+                PlayerAggregate a = history.totalsFor(name);
+                cout << "\n" << name << ": " << a.games << " games, " << a.wins << " wins, "
+                     << a.losses << " losses, " << a.draws << " draws, " << a.cardsWon << " cards won\n";
+                if (a.games > 0) {
+                    cout << CYAN << "\nLatest matches:\n" << RESET;
+                    vector<MatchRecord> recent = history.recentFor(name, 10);
+                    for (size_t i = 0; i < recent.size(); i++) printMatchRecord(recent[i]);
+                }
+            } else if (ch == 2) {
+                string from, to;
+                cout << CYAN << "From date (YYYY-MM-DD): " << RESET;
+                getline(cin, from);
+                cout << CYAN << "To date, inclusive (YYYY-MM-DD): " << RESET;
+                getline(cin, to);
+                long long a = parseDate(from), b = parseDate(to);
+                if (a < 0 || b < 0) {
+                    cout << RED << "Dates must look like 2024-01-31\n" << RESET;
+                } else {
+                    long long count;
+                    vector<MatchRecord> rows = history.between(a, b + 24 * 3600, 20, count);
+                    cout << "\n" << count << " matches\n";
+                    for (size_t i = 0; i < rows.size(); i++) printMatchRecord(rows[i]);
+                    if (count > (long long)rows.size()) cout << "  ... and " << (count - rows.size()) << " more\n";
+                }
+            } else if (ch == 3) {
+                for (int d = 1; d <= 6; d++)
+                    cout << "Distribution mode " << d << ": " << history.countForDistMode(d) << " matches\n";
+            } else {
+                int days = askNumber("Keep the last how many days (0 = keep all): ", 0, 100000);
+                long long cutoff = days == 0 ? 0 : (long long)time(0) - (long long)days * 24 * 3600;
+                cout << GREEN << "Compacted; " << history.compact(cutoff) << " matches kept.\n" << RESET;
+            }
+            waitForEnter();
+        }
+    }
+
+    // Print leaderboard rows starting at a 1-based place
+    void printLeaderboardRows(const vector<pair<string, double> > &rows, int firstPlace, const string &mark) {
+        for (size_t i = 0; i < rows.size(); i++) {
+            bool marked = rows[i].first == mark;
+            cout << (marked ? GREEN : WHITE) << "  " << (firstPlace + (int)i) << ". "
+                 << rows[i].first << "  " << (int)rows[i].second << RESET << "\n";
+        }
+    }
+
+    // Top players by rating, and where a given player stands
+    void showLeaderboard() {
+        const Leaderboard &board = ratings.leaderboard();
+        clearScreen();
+        cout << CYAN << "======== LEADERBOARD ========\n" << RESET;
+        cout << board.playerCount() << " rated players\n\n";
+        printLeaderboardRows(board.top(10), 1, "");
+
+        cout << CYAN << "\nFind player (blank to go back): " << RESET;
+        string name;
+        getline(cin, name);
+        if (!name.empty()) {
+            int rank;
+            vector<pair<string, double> > rows = board.around(ratingKey(name), 5, rank);
+            if (rank == 0) {
+                cout << RED << "No rating for " << name << "\n" << RESET;
+            } else {
+                cout << "\n" << name << " is ranked #" << rank << "\n\n";
+                printLeaderboardRows(rows, max(rank - 5, 1), ratingKey(name));
+            }
+            waitForEnter();
+        }
+    }
+
+    // Outer loop
+    void run() {
+        while (true) {
+            showTitleScreen();
+            int choice = showStartMenu();
+            if (choice == 0) {
+                clearScreen();
+                cout << GREEN << "Thanks for playing Card Battle Game!\n" << RESET;
+                break;
+            }
+            if (choice == 2) runTournament();
+            else if (choice == 3) showLeaderboard();
+            else if (choice == 4) runMatchmaking();
+            else if (choice == 5) resumeSavedGame();
+            else if (choice == 6) showHistoryMenu();
+            else if (choice == 7) editRaritySettings();
+            else runSingleGame();
+        }
+    }
+};
+
+// ===============================
+// MAIN ENTRY POINT
+// ===============================
+
+// Play a keystroke file through the menus; print per-screen latency
+int runScripted(Game &game, const string &scriptPath, const string &capturePath) {
+    ofstream captureFile;
+    if (!capturePath.empty()) captureFile.open(capturePath.c_str(), ios::binary);
+
+    OutputCapture capture(captureFile.is_open() ? captureFile.rdbuf() : 0);
+    ScriptedInput input(capture);
+    if (!input.load(scriptPath)) {
+        cerr << "Cannot read script " << scriptPath << "\n";
+        return 1;
+    }
+
+    streambuf *realOut = cout.rdbuf(&capture);
+    streambuf *realIn = cin.rdbuf(&input);
+    cin.exceptions(ios::badbit);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool finished = true;
+    try {
+        game.run();
+    } catch (ScriptEnded &) {
+        finished = false;
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cin.exceptions(ios::goodbit);
+    cin.clear();
+    cin.rdbuf(realIn);
+    cout.flush();
+    cout.rdbuf(realOut);
+
+    cout << input.linesUsed() << " input lines in " << ms << " ms"
+         << (finished ? "" : " (script ended before the game did)") << "\n\n";
+    input.report(cout);
+    if (!latency().empty()) {
+        cout << "\n";
+        latency().report(cout);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    srand((unsigned)time(0)); // Seed RNG
+    Game game;
+
+    // Scripted run: Game --script keys.txt [--capture screen.txt]
+    if (argc > 2 && string(argv[1]) == "--script") {
+        string capture = (argc > 4 && string(argv[3]) == "--capture") ? argv[4] : "";
+        return runScripted(game, argv[2], capture);
+    }
+
+    // Record the keyboard to a keystroke file for --script
+    streambuf *keyboard = cin.rdbuf();
+    unique_ptr<RecordingInput> recorder;
+    if (argc > 2 && string(argv[1]) == "--record") {
+        recorder.reset(new RecordingInput(keyboard, argv[2]));
+        if (recorder->ok()) cin.rdbuf(recorder.get());
+    }
+
+#ifdef __linux__
+    // Server mode: Game --server tcp:5000 [unix:/tmp/cardbattle.sock]
+    if (argc > 1 && string(argv[1]) == "--server") {
+        vector<string> endpoints(argv + 2, argv + argc);
+        if (endpoints.empty()) endpoints.push_back("tcp:5000");
+        return game.runServer(endpoints);
+    }
+#endif
+
+    game.run();
+    cin.rdbuf(keyboard);
+
+    if (!latency().empty()) {
+        cout << "\n";
+        latency().report(cout);
+    }
+
+    cout << YELLOW << "\nPress any key to exit..." << RESET;
+    terminal().readKey();
+    return 0;
+}
+